@@ -6,11 +6,20 @@
 #include <limits.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define ASCII85_GROUP_SIZE 4
 #define ASCII85_ENCODED_SIZE 5
 #define MAX_LINE_LENGTH 32768
 #define DEFAULT_WRAP_COLS 76
+#define BUFFER_SIZE 65536  // Must stay a multiple of ASCII85_GROUP_SIZE
+#define RUN_SCAN_BYTES 32
+#define DICT_LOOKBACK 1024
+#define MAX_JOBS 256
+#define PARALLEL_CHUNK_SIZE (4 * 1024 * 1024)
 
 typedef enum {
     RESULT_SUCCESS = 0,
@@ -34,6 +43,12 @@ void print_usage(const char *program_name) {
     printf("                        Use 0 to disable line wrapping\n");
     printf("  -z, --zero-compress   use 'z' for all-zero groups (Adobe standard)\n");
     printf("  -y, --space-compress  use 'y' for all-space groups (Adobe standard)\n");
+    printf("  -x, --extract         decode every <~ ~> span and ASCII85Decode PDF stream in FILE\n");
+    printf("  -o, --prefix=PREFIX   with --extract, write stream N to PREFIX0001, PREFIX0002, ...\n");
+    printf("                        instead of concatenating to standard output\n");
+    printf("  -p, --parallel        with --decode, split the input into chunks decoded on\n");
+    printf("                        separate threads (FILE is mapped or read into memory)\n");
+    printf("  -j, --jobs=N          number of decoding threads (default: online CPUs)\n");
     printf("      --help           display this help and exit\n");
     printf("      --version        output version information and exit\n\n");
 }
@@ -67,6 +82,31 @@ static int is_valid_wrap_cols(const char *str, int *value) {
     return 1;
 }
 
+static int is_valid_job_count(const char *str, int *value) {
+    if (str == NULL || value == NULL) {
+        return 0;
+    }
+    
+    char *endptr;
+    errno = 0;
+    long val = strtol(str, &endptr, 10);
+    
+    if (errno == ERANGE || val < 1 || val > MAX_JOBS || *endptr != '\0') {
+        return 0;
+    }
+    
+    *value = (int)val;
+    return 1;
+}
+
+static int default_job_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+    return cpus > MAX_JOBS ? MAX_JOBS : (int)cpus;
+}
+
 static result_t encode_group(const unsigned char *input, size_t len, char *output, 
                            size_t output_size, int use_z, int use_y, size_t *output_len) {
     if (input == NULL || output == NULL || output_len == NULL || 
@@ -161,145 +201,304 @@ static result_t decode_group(const char *input, size_t len, unsigned char *outpu
         value = value * 85 + 84;
     }
     
-    // Unpack 32-bit value to bytes (big-endian)
+    // Unpack 32-bit value to bytes (big-endian); partial groups keep the leading bytes
     *output_len = (len > 1) ? len - 1 : 0;
     for (size_t i = 0; i < *output_len; i++) {
-        output[ASCII85_GROUP_SIZE - 1 - i] = (unsigned char)(value & 0xFF);
-        value >>= 8;
+        output[i] = (unsigned char)(value >> (8 * (ASCII85_GROUP_SIZE - 1 - i)));
     }
     
     return RESULT_SUCCESS;
 }
 
+// Output buffer flushed to stream when full, or grown in memory when stream is NULL
+typedef struct {
+    FILE *stream;
+    char *data;
+    size_t len;
+    size_t cap;
+} out_buffer_t;
+
+static result_t out_flush(out_buffer_t *out) {
+    if (out->stream == NULL) {
+        return RESULT_SUCCESS;
+    }
+    if (out->len > 0 && fwrite(out->data, 1, out->len, out->stream) != out->len) {
+        return RESULT_ERROR_IO;
+    }
+    out->len = 0;
+    return RESULT_SUCCESS;
+}
+
+static result_t out_make_room(out_buffer_t *out) {
+    if (out->stream != NULL) {
+        return out_flush(out);
+    }
+    
+    size_t new_cap = out->cap > 0 ? out->cap * 2 : BUFFER_SIZE;
+    char *new_data = realloc(out->data, new_cap);
+    if (new_data == NULL) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        return RESULT_ERROR_MEMORY;
+    }
+    out->data = new_data;
+    out->cap = new_cap;
+    return RESULT_SUCCESS;
+}
+
+// Append len bytes from src, or len copies of fill when src is NULL
+static result_t out_write(out_buffer_t *out, const void *src, int fill, size_t len) {
+    const unsigned char *bytes = src;
+    
+    while (len > 0) {
+        if (out->len == out->cap) {
+            result_t result = out_make_room(out);
+            if (result != RESULT_SUCCESS) {
+                return result;
+            }
+        }
+        
+        size_t n = out->cap - out->len;
+        if (n > len) {
+            n = len;
+        }
+        
+        if (bytes != NULL) {
+            memcpy(out->data + out->len, bytes, n);
+            bytes += n;
+        } else {
+            memset(out->data + out->len, fill, n);
+        }
+        out->len += n;
+        len -= n;
+    }
+    
+    return RESULT_SUCCESS;
+}
+
+// Append encoded characters, breaking lines every wrap_cols columns
+static result_t out_write_wrapped(out_buffer_t *out, const char *src, int fill, size_t len,
+                                  int wrap_cols, int *col_count) {
+    while (len > 0) {
+        size_t n = len;
+        if (wrap_cols > 0 && n > (size_t)(wrap_cols - *col_count)) {
+            n = (size_t)(wrap_cols - *col_count);
+        }
+        
+        result_t result = out_write(out, src, fill, n);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+        if (src != NULL) {
+            src += n;
+        }
+        len -= n;
+        *col_count += (int)n;
+        
+        // Add line wrap if specified
+        if (wrap_cols > 0 && *col_count >= wrap_cols) {
+            result = out_write(out, "\n", 0, 1);
+            if (result != RESULT_SUCCESS) {
+                return result;
+            }
+            *col_count = 0;
+        }
+        
+        // Prevent extremely long lines
+        if (*col_count > MAX_LINE_LENGTH) {
+            fprintf(stderr, "Error: line too long\n");
+            return RESULT_ERROR_IO;
+        }
+    }
+    
+    return RESULT_SUCCESS;
+}
+
+// Count leading bytes of data equal to byte, comparing RUN_SCAN_BYTES at a time
+static size_t count_repeated(const unsigned char *data, size_t len, unsigned char byte) {
+    const uint64_t pattern = 0x0101010101010101ULL * byte;
+    size_t n = 0;
+    
+    while (n + RUN_SCAN_BYTES <= len) {
+        uint64_t words[RUN_SCAN_BYTES / sizeof(uint64_t)];
+        uint64_t diff = 0;
+        
+        memcpy(words, data + n, RUN_SCAN_BYTES);
+        for (size_t i = 0; i < RUN_SCAN_BYTES / sizeof(uint64_t); i++) {
+            diff |= words[i] ^ pattern;
+        }
+        if (diff != 0) {
+            break;
+        }
+        n += RUN_SCAN_BYTES;
+    }
+    
+    while (n < len && data[n] == byte) {
+        n++;
+    }
+    
+    return n;
+}
+
 static result_t encode_ascii85(FILE *input, FILE *output, int wrap_cols, int use_z, int use_y) {
     if (input == NULL || output == NULL) {
         return RESULT_ERROR_ARGS;
     }
     
-    unsigned char buffer[ASCII85_GROUP_SIZE];
+    unsigned char *buffer = malloc(BUFFER_SIZE);
+    out_buffer_t out = { output, malloc(BUFFER_SIZE), 0, BUFFER_SIZE };
     char encoded[ASCII85_ENCODED_SIZE + 1];
     size_t bytes_read;
     int col_count = 0;
+    result_t result = RESULT_SUCCESS;
     
-    while ((bytes_read = fread(buffer, 1, ASCII85_GROUP_SIZE, input)) > 0) {
+    if (buffer == NULL || out.data == NULL) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        result = RESULT_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    // fread only returns short at end of input, so groups never straddle reads
+    while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, input)) > 0) {
         if (ferror(input)) {
             fprintf(stderr, "Error reading input\n");
-            return RESULT_ERROR_IO;
-        }
-        
-        size_t encoded_len;
-        result_t result = encode_group(buffer, bytes_read, encoded, sizeof(encoded), 
-                                     use_z, use_y, &encoded_len);
-        if (result != RESULT_SUCCESS) {
-            return result;
+            result = RESULT_ERROR_IO;
+            goto cleanup;
         }
         
-        for (size_t i = 0; i < encoded_len; i++) {
-            if (fputc(encoded[i], output) == EOF) {
-                return RESULT_ERROR_IO;
-            }
-            col_count++;
+        size_t pos = 0;
+        while (pos < bytes_read) {
+            size_t avail = bytes_read - pos;
             
-            // Add line wrap if specified
-            if (wrap_cols > 0 && col_count >= wrap_cols) {
-                if (fputc('\n', output) == EOF) {
-                    return RESULT_ERROR_IO;
+            // Emit whole runs of all-zero or all-space groups in one go
+            if (avail >= ASCII85_GROUP_SIZE && (use_z || use_y)) {
+                size_t run = 0;
+                char run_char = 0;
+                
+                if (use_z && buffer[pos] == 0x00) {
+                    run = count_repeated(buffer + pos, avail, 0x00) / ASCII85_GROUP_SIZE;
+                    run_char = 'z';
+                } else if (use_y && buffer[pos] == 0x20) {
+                    run = count_repeated(buffer + pos, avail, 0x20) / ASCII85_GROUP_SIZE;
+                    run_char = 'y';
+                }
+                
+                if (run > 0) {
+                    result = out_write_wrapped(&out, NULL, run_char, run, wrap_cols, &col_count);
+                    if (result != RESULT_SUCCESS) {
+                        goto cleanup;
+                    }
+                    pos += run * ASCII85_GROUP_SIZE;
+                    continue;
                 }
-                col_count = 0;
             }
             
-            // Prevent extremely long lines
-            if (col_count > MAX_LINE_LENGTH) {
-                fprintf(stderr, "Error: line too long\n");
-                return RESULT_ERROR_IO;
+            size_t group_len = avail < ASCII85_GROUP_SIZE ? avail : ASCII85_GROUP_SIZE;
+            size_t encoded_len;
+            result = encode_group(buffer + pos, group_len, encoded, sizeof(encoded),
+                                  use_z, use_y, &encoded_len);
+            if (result != RESULT_SUCCESS) {
+                goto cleanup;
+            }
+            
+            result = out_write_wrapped(&out, encoded, 0, encoded_len, wrap_cols, &col_count);
+            if (result != RESULT_SUCCESS) {
+                goto cleanup;
             }
+            pos += group_len;
         }
     }
     
     // Add final newline if needed
     if (wrap_cols == 0 || col_count > 0) {
-        if (fputc('\n', output) == EOF) {
-            return RESULT_ERROR_IO;
+        if (out_write(&out, "\n", 0, 1) != RESULT_SUCCESS) {
+            result = RESULT_ERROR_IO;
+            goto cleanup;
         }
     }
     
-    return RESULT_SUCCESS;
+    result = out_flush(&out);
+
+cleanup:
+    free(buffer);
+    free(out.data);
+    return result;
 }
 
-static result_t decode_ascii85(FILE *input, FILE *output) {
-    if (input == NULL || output == NULL) {
-        return RESULT_ERROR_ARGS;
-    }
-    
-    char buffer[ASCII85_ENCODED_SIZE];
+// Decoder state carried across input spans
+typedef struct {
+    char group[ASCII85_ENCODED_SIZE];
+    size_t group_len;
+    size_t line_length;
+} decode_state_t;
+
+static result_t decode_span(decode_state_t *state, const unsigned char *data, size_t len,
+                            out_buffer_t *out) {
     unsigned char decoded[ASCII85_GROUP_SIZE];
-    size_t buffer_pos = 0;
-    int c;
-    size_t line_length = 0;
+    result_t result;
     
-    while ((c = fgetc(input)) != EOF) {
-        if (ferror(input)) {
-            fprintf(stderr, "Error reading input\n");
-            return RESULT_ERROR_IO;
-        }
+    for (size_t i = 0; i < len; i++) {
+        int c = data[i];
         
         // Skip whitespace and newlines
         if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
             if (c == '\n') {
-                line_length = 0;
+                state->line_length = 0;
             }
             continue;
         }
         
-        line_length++;
-        if (line_length > MAX_LINE_LENGTH) {
-            fprintf(stderr, "Error: line too long\n");
-            return RESULT_ERROR_DECODE;
-        }
-        
-        // Handle special compression characters
+        // Handle special compression characters, expanding whole runs at once
         if (c == 'z' || c == 'y') {
-            if (buffer_pos > 0) {
+            if (state->group_len > 0) {
                 fprintf(stderr, "Error: compression character in middle of group\n");
                 return RESULT_ERROR_DECODE;
             }
             
-            buffer[0] = (char)c;
-            size_t decoded_len;
-            result_t result = decode_group(buffer, 1, decoded, sizeof(decoded), &decoded_len);
-            if (result != RESULT_SUCCESS) {
-                return result;
+            size_t run = count_repeated(data + i, len - i, (unsigned char)c);
+            state->line_length += run;
+            if (state->line_length > MAX_LINE_LENGTH) {
+                fprintf(stderr, "Error: line too long\n");
+                return RESULT_ERROR_DECODE;
             }
             
-            if (fwrite(decoded, 1, decoded_len, output) != decoded_len) {
-                return RESULT_ERROR_IO;
+            result = out_write(out, NULL, c == 'z' ? 0x00 : 0x20, run * ASCII85_GROUP_SIZE);
+            if (result != RESULT_SUCCESS) {
+                return result;
             }
+            i += run - 1;
             continue;
         }
         
+        state->line_length++;
+        if (state->line_length > MAX_LINE_LENGTH) {
+            fprintf(stderr, "Error: line too long\n");
+            return RESULT_ERROR_DECODE;
+        }
+        
         // Regular ASCII85 character
         if (ascii85_decode_char((unsigned char)c) >= 0) {
-            if (buffer_pos >= ASCII85_ENCODED_SIZE) {
+            if (state->group_len >= ASCII85_ENCODED_SIZE) {
                 fprintf(stderr, "Error: buffer overflow\n");
                 return RESULT_ERROR_DECODE;
             }
             
-            buffer[buffer_pos++] = (char)c;
+            state->group[state->group_len++] = (char)c;
             
             // Process complete group
-            if (buffer_pos == ASCII85_ENCODED_SIZE) {
+            if (state->group_len == ASCII85_ENCODED_SIZE) {
                 size_t decoded_len;
-                result_t result = decode_group(buffer, ASCII85_ENCODED_SIZE, decoded, 
-                                             sizeof(decoded), &decoded_len);
+                result = decode_group(state->group, ASCII85_ENCODED_SIZE, decoded,
+                                      sizeof(decoded), &decoded_len);
                 if (result != RESULT_SUCCESS) {
                     fprintf(stderr, "Error: invalid ASCII85 sequence\n");
                     return result;
                 }
                 
-                if (fwrite(decoded, 1, decoded_len, output) != decoded_len) {
-                    return RESULT_ERROR_IO;
+                result = out_write(out, decoded, 0, decoded_len);
+                if (result != RESULT_SUCCESS) {
+                    return result;
                 }
-                buffer_pos = 0;
+                state->group_len = 0;
             }
         } else {
             fprintf(stderr, "Warning: ignoring invalid character '%c' (0x%02X)\n", 
@@ -307,28 +506,669 @@ static result_t decode_ascii85(FILE *input, FILE *output) {
         }
     }
     
-    // Handle any remaining partial group
-    if (buffer_pos > 0) {
-        if (buffer_pos < 2) {
-            fprintf(stderr, "Error: incomplete ASCII85 group at end\n");
-            return RESULT_ERROR_DECODE;
+    return RESULT_SUCCESS;
+}
+
+// Flush any remaining partial group
+static result_t decode_finish(decode_state_t *state, out_buffer_t *out) {
+    unsigned char decoded[ASCII85_GROUP_SIZE];
+    
+    if (state->group_len == 0) {
+        return RESULT_SUCCESS;
+    }
+    if (state->group_len < 2) {
+        fprintf(stderr, "Error: incomplete ASCII85 group at end\n");
+        return RESULT_ERROR_DECODE;
+    }
+    
+    size_t decoded_len;
+    result_t result = decode_group(state->group, state->group_len, decoded,
+                                   sizeof(decoded), &decoded_len);
+    if (result != RESULT_SUCCESS) {
+        fprintf(stderr, "Error: invalid final ASCII85 group\n");
+        return result;
+    }
+    
+    state->group_len = 0;
+    return out_write(out, decoded, 0, decoded_len);
+}
+
+static result_t decode_ascii85(FILE *input, FILE *output) {
+    if (input == NULL || output == NULL) {
+        return RESULT_ERROR_ARGS;
+    }
+    
+    unsigned char *in_buffer = malloc(BUFFER_SIZE);
+    out_buffer_t out = { output, malloc(BUFFER_SIZE), 0, BUFFER_SIZE };
+    decode_state_t state = { {0}, 0, 0 };
+    size_t bytes_read;
+    result_t result = RESULT_SUCCESS;
+    
+    if (in_buffer == NULL || out.data == NULL) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        result = RESULT_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    while ((bytes_read = fread(in_buffer, 1, BUFFER_SIZE, input)) > 0) {
+        if (ferror(input)) {
+            fprintf(stderr, "Error reading input\n");
+            result = RESULT_ERROR_IO;
+            goto cleanup;
         }
         
-        size_t decoded_len;
-        result_t result = decode_group(buffer, buffer_pos, decoded, sizeof(decoded), &decoded_len);
+        result = decode_span(&state, in_buffer, bytes_read, &out);
+        if (result != RESULT_SUCCESS) {
+            goto cleanup;
+        }
+    }
+    
+    result = decode_finish(&state, &out);
+    if (result == RESULT_SUCCESS) {
+        result = out_flush(&out);
+    }
+
+cleanup:
+    free(in_buffer);
+    free(out.data);
+    return result;
+}
+
+// Whole input held in memory, mapped when it is a regular file
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    int mapped;
+} input_map_t;
+
+static result_t map_input(FILE *input, input_map_t *map) {
+    struct stat st;
+    int fd = fileno(input);
+    
+    map->data = NULL;
+    map->len = 0;
+    map->mapped = 0;
+    
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+            map->data = addr;
+            map->len = (size_t)st.st_size;
+            map->mapped = 1;
+            return RESULT_SUCCESS;
+        }
+    }
+    
+    // Pipes and other unmappable inputs are read into a growing buffer
+    out_buffer_t buf = { NULL, NULL, 0, 0 };
+    for (;;) {
+        if (buf.len == buf.cap) {
+            result_t result = out_make_room(&buf);
+            if (result != RESULT_SUCCESS) {
+                free(buf.data);
+                return result;
+            }
+        }
+        
+        size_t bytes_read = fread(buf.data + buf.len, 1, buf.cap - buf.len, input);
+        if (bytes_read == 0) {
+            break;
+        }
+        buf.len += bytes_read;
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        free(buf.data);
+        return RESULT_ERROR_IO;
+    }
+    
+    map->data = (unsigned char *)buf.data;
+    map->len = buf.len;
+    return RESULT_SUCCESS;
+}
+
+static void unmap_input(input_map_t *map) {
+    if (map->mapped) {
+        munmap(map->data, map->len);
+    } else {
+        free(map->data);
+    }
+    map->data = NULL;
+}
+
+// Find token in data[from, len), using memchr to skip to candidate first bytes
+static const unsigned char *find_token(const unsigned char *data, size_t from, size_t len,
+                                       const char *token) {
+    size_t token_len = strlen(token);
+    
+    while (from + token_len <= len) {
+        const unsigned char *hit = memchr(data + from, token[0], len - from - token_len + 1);
+        if (hit == NULL) {
+            return NULL;
+        }
+        if (memcmp(hit, token, token_len) == 0) {
+            return hit;
+        }
+        from = (size_t)(hit - data) + 1;
+    }
+    
+    return NULL;
+}
+
+// Next "stream" keyword that opens stream data, skipping "endstream"
+static const unsigned char *find_stream_keyword(const unsigned char *data, size_t from, size_t len) {
+    const unsigned char *hit;
+    
+    while ((hit = find_token(data, from, len, "stream")) != NULL) {
+        size_t at = (size_t)(hit - data);
+        size_t after = at + 6;
+        int is_end = at >= 3 && memcmp(hit - 3, "end", 3) == 0;
+        
+        if (!is_end && after < len && (data[after] == '\n' || data[after] == '\r')) {
+            return hit;
+        }
+        from = at + 1;
+    }
+    
+    return NULL;
+}
+
+// A region of the input decoded independently on a worker thread
+typedef struct {
+    size_t start;
+    size_t len;
+    size_t skip;          // leading regular characters owned by the previous span
+    size_t line_length;   // line length carried in from before the span
+    int continues;        // the encoded stream carries on past this span
+    out_buffer_t out;
+    result_t result;
+    int done;
+} stream_span_t;
+
+typedef struct {
+    const unsigned char *data;
+    size_t data_len;
+    stream_span_t *spans;
+    size_t count;
+    size_t next;
+    size_t written;
+    size_t window;
+    int abort;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_t threads[MAX_JOBS];
+    int started;
+} span_job_t;
+
+// Index just past the first count regular characters in data, or len if there are fewer
+static size_t skip_regular(const unsigned char *data, size_t len, size_t count) {
+    size_t i = 0;
+    
+    while (count > 0 && i < len) {
+        if (ascii85_decode_char(data[i]) >= 0) {
+            count--;
+        }
+        i++;
+    }
+    
+    return i;
+}
+
+static result_t decode_stream_span(const span_job_t *job, stream_span_t *span) {
+    const unsigned char *begin = job->data + span->start;
+    size_t skipped = skip_regular(begin, span->len, span->skip);
+    decode_state_t state = { {0}, 0, span->line_length };
+    
+    // The skipped characters were decoded by the previous span, but still
+    // count towards the current line the same way decode_span counts them
+    for (size_t i = 0; i < skipped; i++) {
+        unsigned char c = begin[i];
+        if (c == '\n') {
+            state.line_length = 0;
+        } else if (c != ' ' && c != '\t' && c != '\r') {
+            state.line_length++;
+        }
+    }
+    
+    result_t result = decode_span(&state, begin + skipped, span->len - skipped, &span->out);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    
+    // Complete a group that straddles the end of the span from the data after it
+    if (span->continues && state.group_len > 0) {
+        size_t end = span->start + span->len;
+        size_t tail = skip_regular(job->data + end, job->data_len - end,
+                                   ASCII85_ENCODED_SIZE - state.group_len);
+        result = decode_span(&state, job->data + end, tail, &span->out);
         if (result != RESULT_SUCCESS) {
-            fprintf(stderr, "Error: invalid final ASCII85 group\n");
             return result;
         }
+    }
+    
+    return decode_finish(&state, &span->out);
+}
+
+static void *span_worker(void *arg) {
+    span_job_t *job = arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
         
-        if (fwrite(decoded, 1, decoded_len, output) != decoded_len) {
-            return RESULT_ERROR_IO;
+        // Bound how far decoding may run ahead of the in-order writer
+        while (!job->abort && job->next < job->count && job->next >= job->written + job->window) {
+            pthread_cond_wait(&job->ready, &job->lock);
+        }
+        size_t index = job->next;
+        if (job->abort || index >= job->count) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        job->next++;
+        pthread_mutex_unlock(&job->lock);
+        
+        stream_span_t *span = &job->spans[index];
+        result_t result = decode_stream_span(job, span);
+        
+        pthread_mutex_lock(&job->lock);
+        span->result = result;
+        span->done = 1;
+        pthread_cond_broadcast(&job->ready);
+        pthread_mutex_unlock(&job->lock);
+    }
+    
+    return NULL;
+}
+
+static void start_span_workers(span_job_t *job, int jobs) {
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->ready, NULL);
+    
+    if ((size_t)jobs > job->count) {
+        jobs = (int)job->count;
+    }
+    job->window = (size_t)jobs * 4;
+    job->started = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&job->threads[job->started], NULL, span_worker, job) == 0) {
+            job->started++;
+        }
+    }
+    
+    // Decode inline if no thread could be started
+    if (job->started == 0) {
+        job->window = job->count;
+        span_worker(job);
+    }
+}
+
+// Wait until span index is decoded; the caller must release it afterwards
+static stream_span_t *wait_span(span_job_t *job, size_t index) {
+    stream_span_t *span = &job->spans[index];
+    
+    pthread_mutex_lock(&job->lock);
+    while (!span->done) {
+        pthread_cond_wait(&job->ready, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    
+    return span;
+}
+
+static void release_span(span_job_t *job, stream_span_t *span) {
+    free(span->out.data);
+    span->out.data = NULL;
+    
+    pthread_mutex_lock(&job->lock);
+    job->written++;
+    pthread_cond_broadcast(&job->ready);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void stop_span_workers(span_job_t *job) {
+    pthread_mutex_lock(&job->lock);
+    job->abort = 1;
+    pthread_cond_broadcast(&job->ready);
+    pthread_mutex_unlock(&job->lock);
+    
+    for (int i = 0; i < job->started; i++) {
+        pthread_join(job->threads[i], NULL);
+    }
+    for (size_t i = 0; i < job->count; i++) {
+        free(job->spans[i].out.data);
+    }
+    
+    pthread_cond_destroy(&job->ready);
+    pthread_mutex_destroy(&job->lock);
+}
+
+static result_t add_span(stream_span_t **spans, size_t *count, size_t *cap,
+                         const unsigned char *data, const unsigned char *begin,
+                         const unsigned char *end) {
+    // Stop at the "~>" end-of-data marker when present
+    const unsigned char *eod = find_token(begin, 0, (size_t)(end - begin), "~>");
+    if (eod != NULL) {
+        end = eod;
+    }
+    
+    if (*count == *cap) {
+        size_t new_cap = *cap > 0 ? *cap * 2 : 64;
+        stream_span_t *new_spans = realloc(*spans, new_cap * sizeof(**spans));
+        if (new_spans == NULL) {
+            fprintf(stderr, "Error: memory allocation failed\n");
+            return RESULT_ERROR_MEMORY;
+        }
+        *spans = new_spans;
+        *cap = new_cap;
+    }
+    
+    stream_span_t *span = &(*spans)[(*count)++];
+    memset(span, 0, sizeof(*span));
+    span->start = (size_t)(begin - data);
+    span->len = (size_t)(end - begin);
+    return RESULT_SUCCESS;
+}
+
+// Collect "<~ ... ~>" spans and "stream ... endstream" bodies whose dictionary
+// names the ASCII85Decode filter, in one pass over the input
+static result_t scan_streams(const unsigned char *data, size_t len,
+                             stream_span_t **spans, size_t *count) {
+    const unsigned char *next_open = find_token(data, 0, len, "<~");
+    const unsigned char *next_stream = find_stream_keyword(data, 0, len);
+    size_t cap = 0;
+    size_t pos = 0;
+    
+    *spans = NULL;
+    *count = 0;
+    
+    while (next_open != NULL || next_stream != NULL) {
+        const unsigned char *begin;
+        const unsigned char *end;
+        size_t resume;
+        int is_ascii85 = 1;
+        
+        if (next_open != NULL && (next_stream == NULL || next_open < next_stream)) {
+            begin = next_open + 2;
+            end = find_token(data, (size_t)(begin - data), len, "~>");
+            if (end == NULL) {
+                fprintf(stderr, "Warning: unterminated '<~' at offset %zu\n",
+                        (size_t)(next_open - data));
+                end = data + len;
+            }
+            resume = (size_t)(end - data);
+        } else {
+            size_t keyword = (size_t)(next_stream - data);
+            size_t dict_start = keyword > pos + DICT_LOOKBACK ? keyword - DICT_LOOKBACK : pos;
+            
+            is_ascii85 = find_token(data + dict_start, 0, keyword - dict_start, "/ASCII85Decode") != NULL ||
+                         find_token(data + dict_start, 0, keyword - dict_start, "/A85") != NULL;
+            
+            begin = next_stream + 6;
+            if (*begin == '\r') {
+                begin++;
+            }
+            if (begin < data + len && *begin == '\n') {
+                begin++;
+            }
+            end = find_token(data, (size_t)(begin - data), len, "endstream");
+            if (end == NULL) {
+                end = data + len;
+            }
+            
+            // Skip binary stream bodies so they cannot produce false "<~" matches
+            resume = (size_t)(end - data);
+        }
+        
+        if (is_ascii85) {
+            result_t result = add_span(spans, count, &cap, data, begin, end);
+            if (result != RESULT_SUCCESS) {
+                return result;
+            }
+        }
+        
+        pos = resume;
+        if (next_open != NULL && (size_t)(next_open - data) < pos) {
+            next_open = find_token(data, pos, len, "<~");
+        }
+        if (next_stream != NULL && (size_t)(next_stream - data) < pos) {
+            next_stream = find_stream_keyword(data, pos, len);
         }
     }
     
     return RESULT_SUCCESS;
 }
 
+static result_t write_stream_file(const char *prefix, size_t index, const out_buffer_t *out) {
+    char path[PATH_MAX];
+    
+    if (snprintf(path, sizeof(path), "%s%04zu", prefix, index) >= (int)sizeof(path)) {
+        fprintf(stderr, "Error: output prefix too long\n");
+        return RESULT_ERROR_ARGS;
+    }
+    
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening '%s': %s\n", path, strerror(errno));
+        return RESULT_ERROR_FILE;
+    }
+    
+    result_t result = RESULT_SUCCESS;
+    if (out->len > 0 && fwrite(out->data, 1, out->len, fp) != out->len) {
+        result = RESULT_ERROR_IO;
+    }
+    if (fclose(fp) != 0 && result == RESULT_SUCCESS) {
+        result = RESULT_ERROR_IO;
+    }
+    if (result != RESULT_SUCCESS) {
+        fprintf(stderr, "Error writing '%s': %s\n", path, strerror(errno));
+    }
+    
+    return result;
+}
+
+// Decode every ASCII85 stream in input on worker threads, writing results in order
+static result_t extract_ascii85(FILE *input, FILE *output, const char *prefix, int jobs) {
+    if (input == NULL || output == NULL) {
+        return RESULT_ERROR_ARGS;
+    }
+    
+    input_map_t map;
+    result_t result = map_input(input, &map);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    
+    span_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.data = map.data;
+    job.data_len = map.len;
+    
+    result = scan_streams(map.data, map.len, &job.spans, &job.count);
+    if (result != RESULT_SUCCESS) {
+        goto cleanup;
+    }
+    if (job.count == 0) {
+        fprintf(stderr, "Warning: no ASCII85 streams found\n");
+        goto cleanup;
+    }
+    
+    start_span_workers(&job, jobs);
+    
+    size_t out_offset = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        stream_span_t *span = wait_span(&job, i);
+        
+        if (span->result != RESULT_SUCCESS) {
+            fprintf(stderr, "Warning: stream %zu at offset %zu could not be decoded\n",
+                    i + 1, span->start);
+            result = span->result;
+        } else if (prefix != NULL) {
+            result_t write_result = write_stream_file(prefix, i + 1, &span->out);
+            if (write_result != RESULT_SUCCESS) {
+                result = write_result;
+            }
+        } else {
+            fprintf(stderr, "stream %zu: input offset %zu, %zu bytes at output offset %zu\n",
+                    i + 1, span->start, span->out.len, out_offset);
+            if (span->out.len > 0 && fwrite(span->out.data, 1, span->out.len, output) != span->out.len) {
+                result = RESULT_ERROR_IO;
+            }
+            out_offset += span->out.len;
+        }
+        
+        release_span(&job, span);
+    }
+    
+    stop_span_workers(&job);
+
+cleanup:
+    free(job.spans);
+    unmap_input(&map);
+    return result;
+}
+
+// Per-chunk character counts gathered by the prefix pass
+typedef struct {
+    size_t regular;       // characters that take part in groups
+    size_t tail;          // non-whitespace characters after the last newline
+    int has_newline;
+} chunk_counts_t;
+
+typedef struct {
+    const unsigned char *data;
+    const stream_span_t *chunks;
+    chunk_counts_t *counts;
+    size_t count;
+    size_t stride;
+    size_t offset;
+} chunk_count_job_t;
+
+static void *count_chunks(void *arg) {
+    chunk_count_job_t *job = arg;
+    
+    for (size_t i = job->offset; i < job->count; i += job->stride) {
+        const unsigned char *data = job->data + job->chunks[i].start;
+        size_t len = job->chunks[i].len;
+        chunk_counts_t counts = { 0, 0, 0 };
+        
+        for (size_t j = 0; j < len; j++) {
+            unsigned char c = data[j];
+            if (c == '\n') {
+                counts.has_newline = 1;
+                counts.tail = 0;
+            } else if (c != ' ' && c != '\t' && c != '\r') {
+                counts.tail++;
+                counts.regular += ascii85_decode_char(c) >= 0;
+            }
+        }
+        
+        job->counts[i] = counts;
+    }
+    
+    return NULL;
+}
+
+// Decode one large input by splitting it into chunks that start at a known group phase
+static result_t decode_ascii85_parallel(FILE *input, FILE *output, int jobs) {
+    if (input == NULL || output == NULL) {
+        return RESULT_ERROR_ARGS;
+    }
+    
+    input_map_t map;
+    result_t result = map_input(input, &map);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    
+    span_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.data = map.data;
+    job.data_len = map.len;
+    job.count = (map.len + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    
+    if (job.count == 0) {
+        goto cleanup;
+    }
+    
+    job.spans = calloc(job.count, sizeof(*job.spans));
+    if (job.spans == NULL) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        result = RESULT_ERROR_MEMORY;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < job.count; i++) {
+        job.spans[i].start = i * PARALLEL_CHUNK_SIZE;
+        job.spans[i].len = i + 1 < job.count ? PARALLEL_CHUNK_SIZE : map.len - job.spans[i].start;
+    }
+    
+    // Prefix pass: count regular characters per chunk in parallel
+    chunk_counts_t *counts = malloc(job.count * sizeof(*counts));
+    if (counts == NULL) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        result = RESULT_ERROR_MEMORY;
+        goto cleanup;
+    }
+    
+    chunk_count_job_t counters[MAX_JOBS];
+    pthread_t threads[MAX_JOBS];
+    int started[MAX_JOBS];
+    size_t counting = (size_t)jobs < job.count ? (size_t)jobs : job.count;
+    for (size_t t = 0; t < counting; t++) {
+        chunk_count_job_t counter = { map.data, job.spans, counts, job.count, counting, t };
+        counters[t] = counter;
+        started[t] = t > 0 && pthread_create(&threads[t], NULL, count_chunks, &counters[t]) == 0;
+    }
+    for (size_t t = 0; t < counting; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            count_chunks(&counters[t]);
+        }
+    }
+    
+    // Turn the counts into each chunk's group phase and incoming line length
+    size_t phase = 0;
+    size_t line_length = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        stream_span_t *chunk = &job.spans[i];
+        
+        chunk->skip = (ASCII85_ENCODED_SIZE - phase) % ASCII85_ENCODED_SIZE;
+        chunk->line_length = line_length;
+        chunk->continues = i + 1 < job.count;
+        
+        phase = (phase + counts[i].regular) % ASCII85_ENCODED_SIZE;
+        line_length = counts[i].has_newline ? counts[i].tail : line_length + counts[i].tail;
+    }
+    free(counts);
+    
+    start_span_workers(&job, jobs);
+    
+    // Stitch chunk outputs in order, stopping at the first failure
+    for (size_t i = 0; i < job.count; i++) {
+        stream_span_t *span = wait_span(&job, i);
+        
+        if (span->result != RESULT_SUCCESS) {
+            result = span->result;
+            break;
+        }
+        if (span->out.len > 0 && fwrite(span->out.data, 1, span->out.len, output) != span->out.len) {
+            result = RESULT_ERROR_IO;
+            break;
+        }
+        
+        release_span(&job, span);
+    }
+    
+    stop_span_workers(&job);
+
+cleanup:
+    free(job.spans);
+    unmap_input(&map);
+    return result;
+}
+
 int main(int argc, char *argv[]) {
     if (argc == 0 || argv == NULL) {
         return RESULT_ERROR_ARGS;
@@ -338,6 +1178,10 @@ int main(int argc, char *argv[]) {
     int wrap_cols = DEFAULT_WRAP_COLS;
     int use_z = 0;
     int use_y = 0;
+    int extract_mode = 0;
+    int parallel_mode = 0;
+    int jobs = default_job_count();
+    const char *prefix = NULL;
     const char *filename = NULL;
     FILE *input = NULL;
     FILE *output = stdout;
@@ -348,13 +1192,17 @@ int main(int argc, char *argv[]) {
         {"wrap", required_argument, 0, 'w'},
         {"zero-compress", no_argument, 0, 'z'},
         {"space-compress", no_argument, 0, 'y'},
+        {"extract", no_argument, 0, 'x'},
+        {"prefix", required_argument, 0, 'o'},
+        {"parallel", no_argument, 0, 'p'},
+        {"jobs", required_argument, 0, 'j'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "dw:zyhv", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "dw:zyxo:pj:hv", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 decode_mode = 1;
@@ -371,6 +1219,21 @@ int main(int argc, char *argv[]) {
             case 'y':
                 use_y = 1;
                 break;
+            case 'x':
+                extract_mode = 1;
+                break;
+            case 'o':
+                prefix = optarg;
+                break;
+            case 'p':
+                parallel_mode = 1;
+                break;
+            case 'j':
+                if (!is_valid_job_count(optarg, &jobs)) {
+                    fprintf(stderr, "Error: invalid job count '%s' (must be 1-%d)\n", optarg, MAX_JOBS);
+                    return RESULT_ERROR_ARGS;
+                }
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return RESULT_SUCCESS;
@@ -383,6 +1246,18 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (prefix != NULL && !extract_mode) {
+        fprintf(stderr, "Error: --prefix requires --extract\n");
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        return RESULT_ERROR_ARGS;
+    }
+    
+    if (parallel_mode && !decode_mode) {
+        fprintf(stderr, "Error: --parallel requires --decode\n");
+        fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+        return RESULT_ERROR_ARGS;
+    }
+    
     if (optind < argc) {
         filename = argv[optind];
         if (optind + 1 < argc) {
@@ -404,7 +1279,11 @@ int main(int argc, char *argv[]) {
     }
     
     // Process file
-    if (decode_mode) {
+    if (extract_mode) {
+        result = extract_ascii85(input, output, prefix, jobs);
+    } else if (decode_mode && parallel_mode) {
+        result = decode_ascii85_parallel(input, output, jobs);
+    } else if (decode_mode) {
         result = decode_ascii85(input, output);
     } else {
         result = encode_ascii85(input, output, wrap_cols, use_z, use_y);
@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <limits.h>
+#include <pthread.h>
 
 #define PROGRAM_NAME "base85"
 #define VERSION "1.0.1"
@@ -14,6 +15,9 @@
 #define DECODE_CHUNK 5
 #define MAX_WRAP 1000000
 #define BUFFER_SIZE 8192
+#define GIT_LINE_BYTES 52
+#define GIT_BATCH_LINES 4096
+#define MAX_JOBS 256
 
 // Z85 character set (ZeroMQ Base85 - RFC standard)
 static const char z85_alphabet[] = 
@@ -23,12 +27,12 @@ static const char z85_alphabet[] =
 static const int8_t z85_decoder[256] = {
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0-15
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 16-31
-    -1,68,-1,84,83,82,72,-1,75,76,70,71,-1,69,74,67,  // 32-47  !"#$%&'()*+,-./
-     0, 1, 2, 3, 4, 5, 6, 7, 8, 9,64,-1,73,66,-1,65,  // 48-63  0123456789:;<=>?
-    81,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,  // 64-79  @ABCDEFGHIJKLMNO
-    25,26,27,28,29,30,31,32,33,34,35,77,-1,78,79,80,  // 80-95  PQRSTUVWXYZ[\]^_
-    -1,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,  // 96-111 `abcdefghijklmno
-    51,52,53,54,55,56,57,58,59,60,61,62,63,-1,-1,-1,  // 112-127 pqrstuvwxyz{|}~
+    -1,68,-1,84,83,82,72,-1,75,76,70,65,-1,63,62,69,  // 32-47  !"#$%&'()*+,-./
+     0, 1, 2, 3, 4, 5, 6, 7, 8, 9,64,-1,73,66,74,71,  // 48-63  0123456789:;<=>?
+    81,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,  // 64-79  @ABCDEFGHIJKLMNO
+    51,52,53,54,55,56,57,58,59,60,61,77,-1,78,67,-1,  // 80-95  PQRSTUVWXYZ[\]^_
+    -1,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,  // 96-111 `abcdefghijklmno
+    25,26,27,28,29,30,31,32,33,34,35,79,-1,80,-1,-1,  // 112-127 pqrstuvwxyz{|}~
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 128-143
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 144-159
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 160-175
@@ -39,10 +43,41 @@ static const int8_t z85_decoder[256] = {
     -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1   // 240-255
 };
 
+// Git binary patch character set ("literal"/"delta" hunks in git diffs)
+static const char git_alphabet[] = 
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!#$%&()*+-;<=>?@^_`{|}~";
+
+// Decoder lookup table for the git alphabet
+static const int8_t git_decoder[256] = {
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0-15
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 16-31
+    -1,62,-1,63,64,65,66,-1,67,68,69,70,-1,71,-1,-1,  // 32-47  !"#$%&'()*+,-./
+     0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,72,73,74,75,76,  // 48-63  0123456789:;<=>?
+    77,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,  // 64-79  @ABCDEFGHIJKLMNO
+    25,26,27,28,29,30,31,32,33,34,35,-1,-1,-1,78,79,  // 80-95  PQRSTUVWXYZ[\]^_
+    80,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,  // 96-111 `abcdefghijklmno
+    51,52,53,54,55,56,57,58,59,60,61,81,82,83,84,-1,  // 112-127 pqrstuvwxyz{|}~
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 128-143
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 144-159
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 160-175
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 176-191
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 192-207
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 208-223
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 224-239
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1   // 240-255
+};
+
+// Whitespace skipped silently when decoding (the C locale isspace set)
+static const uint8_t z85_space[256] = {
+    ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1
+};
+
 typedef struct {
     int decode;
     int ignore_garbage;
     int wrap;
+    int git;
+    int jobs;
     const char *input_file;
 } options_t;
 
@@ -64,6 +99,9 @@ static void print_help(void) {
     printf("  -i, --ignore-garbage  when decoding, ignore non-alphabet characters\n");
     printf("  -w, --wrap=COLS       wrap encoded lines after COLS character (default %d).\n", DEFAULT_WRAP);
     printf("                          Use 0 to disable line wrapping\n");
+    printf("  -g, --git             use the git binary patch line format (length-prefixed\n");
+    printf("                          lines of up to %d bytes, git alphabet)\n", GIT_LINE_BYTES);
+    printf("  -j, --jobs=N          threads used to decode --git input (default: online CPUs)\n");
     printf("      --help            display this help and exit\n");
     printf("      --version         output version information and exit\n");
 }
@@ -92,10 +130,35 @@ static int parse_wrap_value(const char *str, int *wrap) {
     return 0;
 }
 
+static int parse_jobs_value(const char *str, int *jobs) {
+    char *endptr;
+    long val;
+    
+    if (str == NULL || *str == '\0') {
+        return -1;
+    }
+    
+    errno = 0;
+    val = strtol(str, &endptr, 10);
+    
+    if (errno != 0 || *endptr != '\0' || val < 1 || val > MAX_JOBS) {
+        return -1;
+    }
+    
+    *jobs = (int)val;
+    return 0;
+}
+
 static int parse_arguments(int argc, char *argv[], options_t *opts) {
     // Initialize with defaults
     memset(opts, 0, sizeof(*opts));
     opts->wrap = DEFAULT_WRAP;
+    opts->jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (opts->jobs < 1) {
+        opts->jobs = 1;
+    } else if (opts->jobs > MAX_JOBS) {
+        opts->jobs = MAX_JOBS;
+    }
     
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--decode") == 0) {
@@ -104,6 +167,25 @@ static int parse_arguments(int argc, char *argv[], options_t *opts) {
         else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore-garbage") == 0) {
             opts->ignore_garbage = 1;
         } 
+        else if (strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--git") == 0) {
+            opts->git = 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc) {
+                print_error("option requires an argument -- 'j'");
+                return -1;
+            }
+            if (parse_jobs_value(argv[++i], &opts->jobs) != 0) {
+                print_error("invalid job count");
+                return -1;
+            }
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            if (parse_jobs_value(argv[i] + 7, &opts->jobs) != 0) {
+                print_error("invalid job count");
+                return -1;
+            }
+        }
         else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--wrap") == 0) {
             if (i + 1 >= argc) {
                 print_error("option requires an argument -- 'w'");
@@ -263,114 +345,196 @@ cleanup:
     return result;
 }
 
+// Left-pack the Z85 digits of data into digits without per-byte branches.
+// Returns the number of digits written; *garbage counts non-space rejects.
+static size_t compact_z85(const uint8_t *data, size_t len, uint8_t *digits, size_t *garbage) {
+    size_t n = 0;
+    size_t rejected = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        int8_t digit = z85_decoder[data[i]];
+        int valid = digit >= 0;
+        
+        digits[n] = (uint8_t)digit;
+        n += (size_t)valid;
+        rejected += (size_t)(!valid & !z85_space[data[i]]);
+    }
+    
+    *garbage = rejected;
+    return n;
+}
+
+// Decode whole groups of packed digits into big-endian 32-bit words
+static size_t decode_z85_groups(const uint8_t *digits, size_t groups, uint8_t *output) {
+    for (size_t g = 0; g < groups; g++) {
+        const uint8_t *d = digits + g * DECODE_CHUNK;
+        uint32_t value = (((d[0] * 85U + d[1]) * 85U + d[2]) * 85U + d[3]) * 85U + d[4];
+        
+        output[0] = (uint8_t)(value >> 24);
+        output[1] = (uint8_t)(value >> 16);
+        output[2] = (uint8_t)(value >> 8);
+        output[3] = (uint8_t)value;
+        output += ENCODE_CHUNK;
+    }
+    
+    return groups * ENCODE_CHUNK;
+}
+
 static int decode_z85(FILE *input, FILE *output, int ignore_garbage) {
-    char *input_buffer = NULL;
+    uint8_t *input_buffer = NULL;
+    uint8_t *digits = NULL;
     uint8_t *output_buffer = NULL;
     int result = 0;
-    uint32_t value = 0;
-    int count = 0;
+    size_t pending = 0;
     
-    // Allocate buffers
+    // Allocate buffers; digits keeps a partial group carried over from the previous read
     input_buffer = malloc(BUFFER_SIZE);
+    digits = malloc(BUFFER_SIZE + DECODE_CHUNK);
     output_buffer = malloc(BUFFER_SIZE);
-    if (input_buffer == NULL || output_buffer == NULL) {
+    if (input_buffer == NULL || digits == NULL || output_buffer == NULL) {
         print_error("memory allocation failed");
         result = 1;
         goto cleanup;
     }
     
     size_t bytes_read;
-    size_t output_pos = 0;
     
     while ((bytes_read = fread(input_buffer, 1, BUFFER_SIZE, input)) > 0) {
-        for (size_t i = 0; i < bytes_read; i++) {
-            int c = (unsigned char)input_buffer[i];
-            
-            // Skip whitespace
-            if (isspace(c)) {
-                continue;
+        size_t garbage;
+        size_t carried = pending;
+        pending += compact_z85(input_buffer, bytes_read, digits + pending, &garbage);
+        
+        // Without -i, write the groups decoded before the first character that
+        // is neither Z85 nor whitespace, then report it
+        if (garbage > 0 && !ignore_garbage) {
+            size_t bad = 0;
+            while (z85_decoder[input_buffer[bad]] != -1 || z85_space[input_buffer[bad]]) {
+                bad++;
             }
             
-            // Validate character
-            if (c < 0 || c > 255 || z85_decoder[c] == -1) {
-                if (ignore_garbage) {
-                    continue;
-                }
-                fprintf(stderr, "%s: invalid character in input: '%c' (0x%02x)\n", 
-                        PROGRAM_NAME, isprint(c) ? c : '?', (unsigned char)c);
+            pending = carried + compact_z85(input_buffer, bad, digits + carried, &garbage);
+            size_t output_len = decode_z85_groups(digits, pending / DECODE_CHUNK, output_buffer);
+            if (output_len > 0 && fwrite(output_buffer, 1, output_len, output) != output_len) {
+                print_error("write error");
                 result = 1;
                 goto cleanup;
             }
             
-            // Accumulate value
-            value = value * 85 + z85_decoder[c];
-            count++;
-            
-            if (count == DECODE_CHUNK) {
-
-                if (output_pos + ENCODE_CHUNK >= BUFFER_SIZE) {
-                    if (fwrite(output_buffer, 1, output_pos, output) != output_pos) {
-                        print_error("write error");
-                        result = 1;
-                        goto cleanup;
-                    }
-                    output_pos = 0;
-                }
-                
-                for (int j = ENCODE_CHUNK - 1; j >= 0; j--) {
-                    output_buffer[output_pos + j] = value & 0xFF;
-                    value >>= 8;
-                }
-                output_pos += ENCODE_CHUNK;
-                
-                value = 0;
-                count = 0;
-            }
+            int c = input_buffer[bad];
+            fprintf(stderr, "%s: invalid character in input: '%c' (0x%02x)\n", 
+                    PROGRAM_NAME, isprint(c) ? c : '?', (unsigned char)c);
+            result = 1;
+            goto cleanup;
         }
+        
+        size_t groups = pending / DECODE_CHUNK;
+        size_t output_len = decode_z85_groups(digits, groups, output_buffer);
+        if (output_len > 0 && fwrite(output_buffer, 1, output_len, output) != output_len) {
+            print_error("write error");
+            result = 1;
+            goto cleanup;
+        }
+        
+        memmove(digits, digits + groups * DECODE_CHUNK, pending - groups * DECODE_CHUNK);
+        pending -= groups * DECODE_CHUNK;
     }
     
     // Handle incomplete final group
-    if (count > 0) {
-        if (count == 1) {
+    if (pending > 0) {
+        if (pending == 1) {
             print_error("invalid input: incomplete final group");
             result = 1;
             goto cleanup;
         }
         
-        // Pad with the highest value character ('$' in Z85 = 84)
-        while (count < DECODE_CHUNK) {
-            value = value * 85 + 84;
-            count++;
+        // Pad with the highest value character ('#' in Z85 = 84)
+        uint32_t value = 0;
+        for (size_t i = 0; i < DECODE_CHUNK; i++) {
+            value = value * 85 + (i < pending ? digits[i] : 84);
         }
         
-
-        int output_bytes = count - 1;
-        if (output_pos + output_bytes >= BUFFER_SIZE) {
-            if (fwrite(output_buffer, 1, output_pos, output) != output_pos) {
-                print_error("write error");
-                result = 1;
-                goto cleanup;
-            }
-            output_pos = 0;
+        // Keep the leading bytes of the padded group
+        size_t output_bytes = pending - 1;
+        for (size_t i = 0; i < output_bytes; i++) {
+            output_buffer[i] = (uint8_t)(value >> (8 * (ENCODE_CHUNK - 1 - i)));
         }
         
-        for (int i = output_bytes - 1; i >= 0; i--) {
-            output_buffer[output_pos + i] = value & 0xFF;
-            value >>= 8;
+        if (fwrite(output_buffer, 1, output_bytes, output) != output_bytes) {
+            print_error("write error");
+            result = 1;
         }
-        output_pos += output_bytes;
+    }
+
+cleanup:
+    free(input_buffer);
+    free(digits);
+    free(output_buffer);
+    
+    if (result == 0 && fflush(output) != 0) {
+        print_error("write error");
+        result = 1;
+    }
+    
+    return result;
+}
+
+// Encode input as git binary patch lines: a length character ('A'-'Z' for
+// 1-26 bytes, 'a'-'z' for 27-52) followed by the base85 groups of the line
+static int encode_git(FILE *input, FILE *output) {
+    uint8_t *buffer = NULL;
+    char *output_buffer = NULL;
+    int result = 0;
+    
+    // BUFFER_SIZE is not a multiple of GIT_LINE_BYTES, so read whole lines only
+    size_t read_size = BUFFER_SIZE - BUFFER_SIZE % GIT_LINE_BYTES;
+    size_t line_chars = 1 + GIT_LINE_BYTES / ENCODE_CHUNK * DECODE_CHUNK + 1;
+    
+    buffer = malloc(read_size);
+    output_buffer = malloc(read_size / GIT_LINE_BYTES * line_chars);
+    if (buffer == NULL || output_buffer == NULL) {
+        print_error("memory allocation failed");
+        result = 1;
+        goto cleanup;
     }
     
-    // Flush remaining output
-    if (output_pos > 0) {
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, read_size, input)) > 0) {
+        size_t output_pos = 0;
+        
+        for (size_t pos = 0; pos < bytes_read; pos += GIT_LINE_BYTES) {
+            size_t line_len = bytes_read - pos < GIT_LINE_BYTES ? bytes_read - pos : GIT_LINE_BYTES;
+            
+            output_buffer[output_pos++] = (char)(line_len <= 26 ? 'A' + line_len - 1 : 'a' + line_len - 27);
+            
+            for (size_t g = 0; g < line_len; g += ENCODE_CHUNK) {
+                uint32_t value = 0;
+                for (size_t i = 0; i < ENCODE_CHUNK; i++) {
+                    value = (value << 8) | (g + i < line_len ? buffer[pos + g + i] : 0);
+                }
+                for (int i = DECODE_CHUNK - 1; i >= 0; i--) {
+                    output_buffer[output_pos + (size_t)i] = git_alphabet[value % 85];
+                    value /= 85;
+                }
+                output_pos += DECODE_CHUNK;
+            }
+            
+            output_buffer[output_pos++] = '\n';
+        }
+        
         if (fwrite(output_buffer, 1, output_pos, output) != output_pos) {
             print_error("write error");
             result = 1;
+            goto cleanup;
         }
     }
+    
+    if (ferror(input)) {
+        print_error("read error");
+        result = 1;
+    }
 
 cleanup:
-    free(input_buffer);
+    free(buffer);
     free(output_buffer);
     
     if (result == 0 && fflush(output) != 0) {
@@ -381,6 +545,238 @@ cleanup:
     return result;
 }
 
+// One git line located by the indexing pass
+typedef struct {
+    size_t start;       // offset of the first base85 character
+    size_t len;         // base85 characters, excluding length byte and line end
+    size_t out_offset;  // where its bytes go in the decoded output
+    uint8_t out_len;
+} git_line_t;
+
+typedef struct {
+    const uint8_t *data;
+    const git_line_t *lines;
+    size_t line_count;
+    uint8_t *output;
+    size_t first_batch;
+    size_t batch_stride;
+    size_t bad_line;    // first corrupt line seen by this worker, or line_count
+} git_decode_job_t;
+
+static int decode_git_line(const uint8_t *src, const git_line_t *line, uint8_t *dst) {
+    size_t remaining = line->out_len;
+    
+    for (size_t g = 0; g < line->len; g += DECODE_CHUNK) {
+        uint32_t value = 0;
+        
+        for (size_t i = 0; i < DECODE_CHUNK; i++) {
+            int digit = git_decoder[src[g + i]];
+            if (digit < 0 || value > (UINT32_MAX - (uint32_t)digit) / 85) {
+                return -1;
+            }
+            value = value * 85 + (uint32_t)digit;
+        }
+        
+        size_t n = remaining < ENCODE_CHUNK ? remaining : ENCODE_CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            *dst++ = (uint8_t)(value >> (8 * (ENCODE_CHUNK - 1 - i)));
+        }
+        remaining -= n;
+    }
+    
+    return 0;
+}
+
+static void *decode_git_batches(void *arg) {
+    git_decode_job_t *job = arg;
+    
+    for (size_t batch = job->first_batch; batch * GIT_BATCH_LINES < job->line_count;
+         batch += job->batch_stride) {
+        size_t end = (batch + 1) * GIT_BATCH_LINES;
+        if (end > job->line_count) {
+            end = job->line_count;
+        }
+        
+        for (size_t i = batch * GIT_BATCH_LINES; i < end; i++) {
+            const git_line_t *line = &job->lines[i];
+            if (decode_git_line(job->data + line->start, line, job->output + line->out_offset) != 0) {
+                if (i < job->bad_line) {
+                    job->bad_line = i;
+                }
+                return NULL;
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+// Decode git binary patch lines. Every line carries its own length, so the
+// input is indexed once and batches of lines decode on separate threads
+// straight into their final place in the output.
+static int decode_git(FILE *input, FILE *output, int jobs) {
+    uint8_t *data = NULL;
+    git_line_t *lines = NULL;
+    uint8_t *decoded = NULL;
+    size_t data_len = 0;
+    size_t data_cap = 0;
+    size_t line_count = 0;
+    size_t line_cap = 0;
+    size_t total = 0;
+    int result = 0;
+    
+    // Read the whole input
+    for (;;) {
+        if (data_len == data_cap) {
+            size_t new_cap = data_cap > 0 ? data_cap * 2 : BUFFER_SIZE * 8;
+            uint8_t *new_data = realloc(data, new_cap);
+            if (new_data == NULL) {
+                print_error("memory allocation failed");
+                result = 1;
+                goto cleanup;
+            }
+            data = new_data;
+            data_cap = new_cap;
+        }
+        
+        size_t bytes_read = fread(data + data_len, 1, data_cap - data_len, input);
+        if (bytes_read == 0) {
+            break;
+        }
+        data_len += bytes_read;
+    }
+    if (ferror(input)) {
+        print_error("read error");
+        result = 1;
+        goto cleanup;
+    }
+    
+    // Index lines and their output offsets, stopping at the first malformed
+    // one so the lines before it are still decoded and written
+    int bad_length = 0;     // 1: invalid length character, 2: length mismatch
+    for (size_t pos = 0; pos < data_len; ) {
+        const uint8_t *nl = memchr(data + pos, '\n', data_len - pos);
+        size_t end = nl != NULL ? (size_t)(nl - data) : data_len;
+        size_t next = nl != NULL ? end + 1 : data_len;
+        
+        if (end > pos && data[end - 1] == '\r') {
+            end--;
+        }
+        
+        // Blank lines separate hunks in a patch
+        if (end == pos) {
+            pos = next;
+            continue;
+        }
+        
+        int c = data[pos];
+        size_t out_len;
+        if (c >= 'A' && c <= 'Z') {
+            out_len = (size_t)(c - 'A' + 1);
+        } else if (c >= 'a' && c <= 'z') {
+            out_len = (size_t)(c - 'a' + 27);
+        } else {
+            bad_length = 1;
+            break;
+        }
+        
+        if (end - pos - 1 != (out_len + ENCODE_CHUNK - 1) / ENCODE_CHUNK * DECODE_CHUNK) {
+            bad_length = 2;
+            break;
+        }
+        
+        if (line_count == line_cap) {
+            size_t new_cap = line_cap > 0 ? line_cap * 2 : GIT_BATCH_LINES;
+            git_line_t *new_lines = realloc(lines, new_cap * sizeof(*lines));
+            if (new_lines == NULL) {
+                print_error("memory allocation failed");
+                result = 1;
+                goto cleanup;
+            }
+            lines = new_lines;
+            line_cap = new_cap;
+        }
+        
+        git_line_t *line = &lines[line_count++];
+        line->start = pos + 1;
+        line->len = end - pos - 1;
+        line->out_offset = total;
+        line->out_len = (uint8_t)out_len;
+        total += out_len;
+        pos = next;
+    }
+    
+    if (line_count == 0) {
+        goto report;
+    }
+    
+    decoded = malloc(total);
+    if (decoded == NULL) {
+        print_error("memory allocation failed");
+        result = 1;
+        goto cleanup;
+    }
+    
+    // Hand out batches round-robin; thread 0 runs on the calling thread
+    size_t batches = (line_count + GIT_BATCH_LINES - 1) / GIT_BATCH_LINES;
+    size_t workers = (size_t)jobs < batches ? (size_t)jobs : batches;
+    git_decode_job_t job_list[MAX_JOBS];
+    pthread_t threads[MAX_JOBS];
+    int started[MAX_JOBS];
+    
+    for (size_t t = 0; t < workers; t++) {
+        git_decode_job_t job = { data, lines, line_count, decoded, t, workers, line_count };
+        job_list[t] = job;
+        started[t] = t > 0 && pthread_create(&threads[t], NULL, decode_git_batches, &job_list[t]) == 0;
+    }
+    
+    size_t bad_line = line_count;
+    for (size_t t = 0; t < workers; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            decode_git_batches(&job_list[t]);
+        }
+        if (job_list[t].bad_line < bad_line) {
+            bad_line = job_list[t].bad_line;
+        }
+    }
+    
+    // Write everything before the first corrupt line, as a sequential decoder would
+    size_t good = bad_line < line_count ? lines[bad_line].out_offset : total;
+    if (good > 0 && fwrite(decoded, 1, good, output) != good) {
+        print_error("write error");
+        result = 1;
+        goto cleanup;
+    }
+    if (bad_line < line_count) {
+        fprintf(stderr, "%s: corrupt data on line %zu\n", PROGRAM_NAME, bad_line + 1);
+        result = 1;
+        goto cleanup;
+    }
+
+report:
+    if (bad_length == 1) {
+        fprintf(stderr, "%s: invalid length character on line %zu\n", PROGRAM_NAME, line_count + 1);
+        result = 1;
+    } else if (bad_length == 2) {
+        fprintf(stderr, "%s: corrupt line %zu: length does not match data\n", PROGRAM_NAME, line_count + 1);
+        result = 1;
+    }
+
+cleanup:
+    free(data);
+    free(lines);
+    free(decoded);
+    
+    if (result == 0 && fflush(output) != 0) {
+        print_error("write error");
+        result = 1;
+    }
+    
+    return result;
+}
+
 int main(int argc, char *argv[]) {
     options_t opts;
     FILE *input = NULL;
@@ -398,7 +794,9 @@ int main(int argc, char *argv[]) {
     }
     
     // Process the data
-    if (opts.decode) {
+    if (opts.git) {
+        result = opts.decode ? decode_git(input, stdout, opts.jobs) : encode_git(input, stdout);
+    } else if (opts.decode) {
         result = decode_z85(input, stdout, opts.ignore_garbage);
     } else {
         result = encode_z85(input, stdout, opts.wrap);
@@ -3,34 +3,197 @@
 #include <string.h>
 #include <getopt.h>
 #include <ctype.h>
-#include <wchar.h>
-#include <locale.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BRAILLE_BASE 0x2800
 #define BRAILLE_CAPITAL 0x20
 #define BRAILLE_NUMBER 0x3C
 #define MAX_LINE_LENGTH 8192
+#define BUFFER_SIZE 65536
+#define OUTPUT_BUFFER_SIZE 65536
 #define PATTERN_LENGTH 6
+#define DEFAULT_WRAP_CELLS 64
+#define MAX_WRAP_CELLS 1000000
+#define BRF_CELLS_PER_LINE 40
+#define BRF_LINES_PER_PAGE 25
+#define DEFAULT_GRID_CELL_WIDTH 3
+#define MAX_GRID_CELL_WIDTH 16
+
+// Cell patterns use the Unicode dot bits: dot 1 = 0x01 ... dot 6 = 0x20.
+// Each list is expanded into the direct-indexed tables below, so lookups are
+// a single load. Digits share the patterns of A-J and are told apart by the
+// number sign; ')' uses the Braille ASCII closing cell so that it does not
+// collide with '('.
+#define BRAILLE_LETTERS(X) \
+    X('A', 'a', 0x01) X('B', 'b', 0x03) X('C', 'c', 0x09) X('D', 'd', 0x19) \
+    X('E', 'e', 0x11) X('F', 'f', 0x0B) X('G', 'g', 0x1B) X('H', 'h', 0x13) \
+    X('I', 'i', 0x0A) X('J', 'j', 0x1A) X('K', 'k', 0x05) X('L', 'l', 0x07) \
+    X('M', 'm', 0x0D) X('N', 'n', 0x1D) X('O', 'o', 0x15) X('P', 'p', 0x0F) \
+    X('Q', 'q', 0x1F) X('R', 'r', 0x17) X('S', 's', 0x0E) X('T', 't', 0x1E) \
+    X('U', 'u', 0x25) X('V', 'v', 0x27) X('W', 'w', 0x3A) X('X', 'x', 0x2D) \
+    X('Y', 'y', 0x3D) X('Z', 'z', 0x35)
+
+#define BRAILLE_DIGITS(X) \
+    X('1', 0x01) X('2', 0x03) X('3', 0x09) X('4', 0x19) X('5', 0x11) \
+    X('6', 0x0B) X('7', 0x1B) X('8', 0x13) X('9', 0x0A) X('0', 0x1A)
+
+#define BRAILLE_PUNCTUATION(X) \
+    X('.', 0x2C) X(',', 0x02) X('?', 0x26) X('!', 0x16) X(';', 0x06) \
+    X(':', 0x12) X('-', 0x24) X('\'', 0x04) X('"', 0x10) X('(', 0x2E) \
+    X(')', 0x3E) X('/', 0x0C) X(' ', 0x00)
+
+// Encode table: BRAILLE_VALID | pattern, 0 for unsupported bytes
+#define BRAILLE_VALID 0x40
+#define ENCODE_LETTER(upper, lower, pattern) \
+    [(unsigned char)(upper)] = BRAILLE_VALID | (pattern), [(unsigned char)(lower)] = BRAILLE_VALID | (pattern),
+#define ENCODE_SYMBOL(c, pattern) [(unsigned char)(c)] = BRAILLE_VALID | (pattern),
+
+static const unsigned char encode_cells[256] = {
+    BRAILLE_LETTERS(ENCODE_LETTER)
+    BRAILLE_DIGITS(ENCODE_SYMBOL)
+    BRAILLE_PUNCTUATION(ENCODE_SYMBOL)
+};
+
+// Decode tables by pattern: 0 for patterns with no meaning
+#define DECODE_UPPER(upper, lower, pattern) [pattern] = (upper),
+#define DECODE_LOWER(upper, lower, pattern) [pattern] = (lower),
+#define DECODE_SYMBOL(c, pattern) [pattern] = (c),
+
+static const char decode_capital[64] = {
+    BRAILLE_LETTERS(DECODE_UPPER)
+    BRAILLE_PUNCTUATION(DECODE_SYMBOL)
+};
+
+static const char decode_lower[64] = {
+    BRAILLE_LETTERS(DECODE_LOWER)
+    BRAILLE_PUNCTUATION(DECODE_SYMBOL)
+};
+
+static const char decode_digit[64] = {
+    BRAILLE_DIGITS(DECODE_SYMBOL)
+};
+
+// Accent indicators, written before the letter they modify. Marks that
+// have no indicator here are dropped and only the base letter is written.
+typedef enum {
+    ACCENT_NONE = 0,
+    ACCENT_ACUTE,
+    ACCENT_GRAVE,
+    ACCENT_CIRCUMFLEX,
+    ACCENT_TILDE,
+    ACCENT_DIAERESIS,
+    ACCENT_CEDILLA,
+    ACCENT_RING,
+    ACCENT_CARON,
+    ACCENT_BREVE,
+    ACCENT_MACRON,
+    ACCENT_STROKE,
+    ACCENT_DOT,
+    ACCENT_DOUBLE_ACUTE,
+    ACCENT_OGONEK
+} accent_t;
+
+static const unsigned char accent_cells[ACCENT_OGONEK + 1][2] = {
+    [ACCENT_ACUTE] = {0x18, 0x0C},
+    [ACCENT_GRAVE] = {0x18, 0x21},
+    [ACCENT_CIRCUMFLEX] = {0x18, 0x29},
+    [ACCENT_TILDE] = {0x18, 0x3B},
+    [ACCENT_DIAERESIS] = {0x18, 0x12},
+    [ACCENT_CEDILLA] = {0x18, 0x2F},
+    [ACCENT_RING] = {0x18, 0x2B},
+    [ACCENT_CARON] = {0x18, 0x2C},
+    [ACCENT_BREVE] = {0x08, 0x2C},
+    [ACCENT_MACRON] = {0x08, 0x24},
+    [ACCENT_STROKE] = {0x08, 0x31}
+};
+
+// Latin-1 Supplement and Latin Extended-A, as ASCII text plus an accent
+#define LATIN_TRANSLITERATIONS(X) \
+    X(0x0A0, " ", NONE) X(0x0A1, "!", NONE) X(0x0AB, "\"", NONE) X(0x0AD, "-", NONE) \
+    X(0x0B7, ".", NONE) X(0x0BB, "\"", NONE) X(0x0BF, "?", NONE) X(0x0C0, "A", GRAVE) \
+    X(0x0C1, "A", ACUTE) X(0x0C2, "A", CIRCUMFLEX) X(0x0C3, "A", TILDE) \
+    X(0x0C4, "A", DIAERESIS) X(0x0C5, "A", RING) X(0x0C6, "AE", NONE) X(0x0C7, "C", CEDILLA) \
+    X(0x0C8, "E", GRAVE) X(0x0C9, "E", ACUTE) X(0x0CA, "E", CIRCUMFLEX) \
+    X(0x0CB, "E", DIAERESIS) X(0x0CC, "I", GRAVE) X(0x0CD, "I", ACUTE) \
+    X(0x0CE, "I", CIRCUMFLEX) X(0x0CF, "I", DIAERESIS) X(0x0D0, "D", STROKE) \
+    X(0x0D1, "N", TILDE) X(0x0D2, "O", GRAVE) X(0x0D3, "O", ACUTE) X(0x0D4, "O", CIRCUMFLEX) \
+    X(0x0D5, "O", TILDE) X(0x0D6, "O", DIAERESIS) X(0x0D8, "O", STROKE) X(0x0D9, "U", GRAVE) \
+    X(0x0DA, "U", ACUTE) X(0x0DB, "U", CIRCUMFLEX) X(0x0DC, "U", DIAERESIS) \
+    X(0x0DD, "Y", ACUTE) X(0x0DE, "TH", NONE) X(0x0DF, "ss", NONE) X(0x0E0, "a", GRAVE) \
+    X(0x0E1, "a", ACUTE) X(0x0E2, "a", CIRCUMFLEX) X(0x0E3, "a", TILDE) \
+    X(0x0E4, "a", DIAERESIS) X(0x0E5, "a", RING) X(0x0E6, "ae", NONE) X(0x0E7, "c", CEDILLA) \
+    X(0x0E8, "e", GRAVE) X(0x0E9, "e", ACUTE) X(0x0EA, "e", CIRCUMFLEX) \
+    X(0x0EB, "e", DIAERESIS) X(0x0EC, "i", GRAVE) X(0x0ED, "i", ACUTE) \
+    X(0x0EE, "i", CIRCUMFLEX) X(0x0EF, "i", DIAERESIS) X(0x0F0, "d", STROKE) \
+    X(0x0F1, "n", TILDE) X(0x0F2, "o", GRAVE) X(0x0F3, "o", ACUTE) X(0x0F4, "o", CIRCUMFLEX) \
+    X(0x0F5, "o", TILDE) X(0x0F6, "o", DIAERESIS) X(0x0F8, "o", STROKE) X(0x0F9, "u", GRAVE) \
+    X(0x0FA, "u", ACUTE) X(0x0FB, "u", CIRCUMFLEX) X(0x0FC, "u", DIAERESIS) \
+    X(0x0FD, "y", ACUTE) X(0x0FE, "th", NONE) X(0x0FF, "y", DIAERESIS) X(0x100, "A", MACRON) \
+    X(0x101, "a", MACRON) X(0x102, "A", BREVE) X(0x103, "a", BREVE) X(0x104, "A", OGONEK) \
+    X(0x105, "a", OGONEK) X(0x106, "C", ACUTE) X(0x107, "c", ACUTE) \
+    X(0x108, "C", CIRCUMFLEX) X(0x109, "c", CIRCUMFLEX) X(0x10A, "C", DOT) \
+    X(0x10B, "c", DOT) X(0x10C, "C", CARON) X(0x10D, "c", CARON) X(0x10E, "D", CARON) \
+    X(0x10F, "d", CARON) X(0x110, "D", STROKE) X(0x111, "d", STROKE) X(0x112, "E", MACRON) \
+    X(0x113, "e", MACRON) X(0x114, "E", BREVE) X(0x115, "e", BREVE) X(0x116, "E", DOT) \
+    X(0x117, "e", DOT) X(0x118, "E", OGONEK) X(0x119, "e", OGONEK) X(0x11A, "E", CARON) \
+    X(0x11B, "e", CARON) X(0x11C, "G", CIRCUMFLEX) X(0x11D, "g", CIRCUMFLEX) \
+    X(0x11E, "G", BREVE) X(0x11F, "g", BREVE) X(0x120, "G", DOT) X(0x121, "g", DOT) \
+    X(0x122, "G", CEDILLA) X(0x123, "g", CEDILLA) X(0x124, "H", CIRCUMFLEX) \
+    X(0x125, "h", CIRCUMFLEX) X(0x126, "H", STROKE) X(0x127, "h", STROKE) \
+    X(0x128, "I", TILDE) X(0x129, "i", TILDE) X(0x12A, "I", MACRON) X(0x12B, "i", MACRON) \
+    X(0x12C, "I", BREVE) X(0x12D, "i", BREVE) X(0x12E, "I", OGONEK) X(0x12F, "i", OGONEK) \
+    X(0x130, "I", DOT) X(0x131, "i", NONE) X(0x132, "IJ", NONE) X(0x133, "ij", NONE) \
+    X(0x134, "J", CIRCUMFLEX) X(0x135, "j", CIRCUMFLEX) X(0x136, "K", CEDILLA) \
+    X(0x137, "k", CEDILLA) X(0x138, "q", NONE) X(0x139, "L", ACUTE) X(0x13A, "l", ACUTE) \
+    X(0x13B, "L", CEDILLA) X(0x13C, "l", CEDILLA) X(0x13D, "L", CARON) X(0x13E, "l", CARON) \
+    X(0x13F, "L", DOT) X(0x140, "l", DOT) X(0x141, "L", STROKE) X(0x142, "l", STROKE) \
+    X(0x143, "N", ACUTE) X(0x144, "n", ACUTE) X(0x145, "N", CEDILLA) X(0x146, "n", CEDILLA) \
+    X(0x147, "N", CARON) X(0x148, "n", CARON) X(0x149, "n", NONE) X(0x14A, "N", NONE) \
+    X(0x14B, "n", NONE) X(0x14C, "O", MACRON) X(0x14D, "o", MACRON) X(0x14E, "O", BREVE) \
+    X(0x14F, "o", BREVE) X(0x150, "O", DOUBLE_ACUTE) X(0x151, "o", DOUBLE_ACUTE) \
+    X(0x152, "OE", NONE) X(0x153, "oe", NONE) X(0x154, "R", ACUTE) X(0x155, "r", ACUTE) \
+    X(0x156, "R", CEDILLA) X(0x157, "r", CEDILLA) X(0x158, "R", CARON) X(0x159, "r", CARON) \
+    X(0x15A, "S", ACUTE) X(0x15B, "s", ACUTE) X(0x15C, "S", CIRCUMFLEX) \
+    X(0x15D, "s", CIRCUMFLEX) X(0x15E, "S", CEDILLA) X(0x15F, "s", CEDILLA) \
+    X(0x160, "S", CARON) X(0x161, "s", CARON) X(0x162, "T", CEDILLA) X(0x163, "t", CEDILLA) \
+    X(0x164, "T", CARON) X(0x165, "t", CARON) X(0x166, "T", STROKE) X(0x167, "t", STROKE) \
+    X(0x168, "U", TILDE) X(0x169, "u", TILDE) X(0x16A, "U", MACRON) X(0x16B, "u", MACRON) \
+    X(0x16C, "U", BREVE) X(0x16D, "u", BREVE) X(0x16E, "U", RING) X(0x16F, "u", RING) \
+    X(0x170, "U", DOUBLE_ACUTE) X(0x171, "u", DOUBLE_ACUTE) X(0x172, "U", OGONEK) \
+    X(0x173, "u", OGONEK) X(0x174, "W", CIRCUMFLEX) X(0x175, "w", CIRCUMFLEX) \
+    X(0x176, "Y", CIRCUMFLEX) X(0x177, "y", CIRCUMFLEX) X(0x178, "Y", DIAERESIS) \
+    X(0x179, "Z", ACUTE) X(0x17A, "z", ACUTE) X(0x17B, "Z", DOT) X(0x17C, "z", DOT) \
+    X(0x17D, "Z", CARON) X(0x17E, "z", CARON) X(0x17F, "s", NONE)
+
+#define TYPOGRAPHIC_TRANSLITERATIONS(X) \
+    X(0x2010, "-", NONE) X(0x2011, "-", NONE) X(0x2013, "-", NONE) X(0x2014, "-", NONE) \
+    X(0x2018, "'", NONE) X(0x2019, "'", NONE) X(0x201C, "\"", NONE) X(0x201D, "\"", NONE) \
+    X(0x2026, "...", NONE)
+
+#define LATIN_FIRST 0xA0
+#define LATIN_LAST 0x17F
 
 typedef struct {
-    char character;
-    unsigned char pattern;
-} BrailleEntry;
-
-static const BrailleEntry braille_table[] = {
-    {'A', 0x01}, {'B', 0x03}, {'C', 0x09}, {'D', 0x19}, {'E', 0x11}, {'F', 0x0B},
-    {'G', 0x1B}, {'H', 0x13}, {'I', 0x0A}, {'J', 0x1A}, {'K', 0x05}, {'L', 0x07},
-    {'M', 0x0D}, {'N', 0x1D}, {'O', 0x15}, {'P', 0x0F}, {'Q', 0x1F}, {'R', 0x17},
-    {'S', 0x0E}, {'T', 0x1E}, {'U', 0x25}, {'V', 0x27}, {'W', 0x3A}, {'X', 0x2D},
-    {'Y', 0x3D}, {'Z', 0x35},
-    {'1', 0x01}, {'2', 0x03}, {'3', 0x09}, {'4', 0x19}, {'5', 0x11},
-    {'6', 0x0B}, {'7', 0x1B}, {'8', 0x13}, {'9', 0x0A}, {'0', 0x1A},
-    {'.', 0x2C}, {',', 0x02}, {'?', 0x26}, {'!', 0x16}, {';', 0x06}, 
-    {':', 0x12}, {'-', 0x24}, {'\'', 0x04}, {'"', 0x10}, {'(', 0x2E}, 
-    {')', 0x2E}, {'/', 0x0C}, {' ', 0x00},
-    {'\0', 0}
+    uint32_t code_point;
+    char text[4];
+    unsigned char accent;
+} Transliteration;
+
+#define TRANSLIT_LATIN(cp, text, accent) [(cp) - LATIN_FIRST] = {(cp), text, ACCENT_##accent},
+#define TRANSLIT_ENTRY(cp, text, accent) {(cp), text, ACCENT_##accent},
+
+static const Transliteration latin_transliterations[LATIN_LAST - LATIN_FIRST + 1] = {
+    LATIN_TRANSLITERATIONS(TRANSLIT_LATIN)
+};
+
+static const Transliteration typographic_transliterations[] = {
+    TYPOGRAPHIC_TRANSLITERATIONS(TRANSLIT_ENTRY)
 };
 
 typedef enum {
@@ -42,174 +205,2546 @@ typedef enum {
     RESULT_ERROR_ENCODING
 } result_t;
 
+// How encoded cells are written
+typedef enum {
+    FORMAT_UNICODE = 0,
+    FORMAT_TEXT,
+    FORMAT_BRF,
+    FORMAT_GRID
+} cell_format_t;
+
+// Long options without a short form
+enum {
+    OPT_BRF = 256,
+    OPT_GRID,
+    OPT_CELL_WIDTH,
+    OPT_TABLE
+};
+
 void print_usage(const char *program_name) {
     printf("Usage: %s [OPTION]... [FILE]\n", program_name);
     printf("Braille encode or decode FILE, or standard input, to standard output.\n");
-    printf("With no FILE, or when FILE is -, read standard input.\n\n");
+    printf("With no FILE, or when FILE is -, read standard input.\n");
+    printf("Text is read as UTF-8; accented Latin letters are written as the base\n");
+    printf("letter after an accent indicator.\n\n");
     printf("  -d, --decode          decode braille (convert braille unicode to text)\n");
     printf("  -t, --text-braille    use text representation (dots/spaces) instead of unicode\n");
+    printf("  -b, --binary          encode arbitrary bytes as 8-dot cells, one per byte\n");
+    printf("                        (U+2800 + byte); decoding ignores everything else\n");
+    printf("      --brf             write Braille ASCII (BRF) for embossers, laid out in\n");
+    printf("                        pages of %d cells by %d lines with page numbers\n", BRF_CELLS_PER_LINE, BRF_LINES_PER_PAGE);
+    printf("  -g, --grade2          contracted (Grade 2) braille: groupsigns such as 'and',\n");
+    printf("                        'the' and 'ing', and whole-word signs such as 'but'\n");
+    printf("      --grid            draw each cell as two columns of dots over three rows;\n");
+    printf("                        a blank line ends each braille line\n");
+    printf("      --cell-width=N    bytes per grid cell, including the gap (default %d)\n", DEFAULT_GRID_CELL_WIDTH);
+    printf("      --table=FILE      encode with a liblouis-format translation table; the\n");
+    printf("                        compiled table is cached in FILE.cache\n");
+    printf("  -w, --wrap=CELLS      wrap binary and grid output after CELLS cells (default %d)\n", DEFAULT_WRAP_CELLS);
+    printf("                        Use 0 to disable line wrapping\n");
     printf("      --help           display this help and exit\n");
     printf("      --version        output version information and exit\n\n");
 }
 
-void print_version(void) {
-    printf("braille 1.0\n");
-    printf("Braille encoder/decoder (Grade 1 Braille)\n");
+void print_version(void) {
+    printf("braille 1.0\n");
+    printf("Braille encoder/decoder (Grade 1 Braille)\n");
+}
+
+static unsigned char char_to_braille(char c) {
+    unsigned char cell = encode_cells[(unsigned char)c];
+    return cell ? (unsigned char)(cell & ~BRAILLE_VALID) : 0xFF;
+}
+
+static char braille_to_char(unsigned char pattern, int is_number, int is_capital) {
+    pattern &= 0x3F;
+    if (is_number && decode_digit[pattern]) {
+        return decode_digit[pattern];
+    }
+    
+    char c = is_capital ? decode_capital[pattern] : decode_lower[pattern];
+    return c || pattern == 0x00 ? c : '?';
+}
+
+// Decode one UTF-8 sequence into *code_point and return its length. Returns
+// 0 when the sequence runs past the end of the data and more may follow,
+// and -1 for a byte that does not start a valid sequence.
+static int utf8_decode(const unsigned char *p, size_t avail, int at_eof, uint32_t *code_point) {
+    int len;
+    uint32_t cp;
+    unsigned char low = 0x80, high = 0xBF;
+    
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+        len = 2;
+        cp = p[0] & 0x1F;
+    } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        len = 3;
+        cp = p[0] & 0x0F;
+        low = p[0] == 0xE0 ? 0xA0 : 0x80;   // no overlong forms
+        high = p[0] == 0xED ? 0x9F : 0xBF;  // no surrogates
+    } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        len = 4;
+        cp = p[0] & 0x07;
+        low = p[0] == 0xF0 ? 0x90 : 0x80;
+        high = p[0] == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        return -1;
+    }
+    
+    for (int k = 1; k < len; k++) {
+        if ((size_t)k == avail) {
+            return at_eof ? -1 : 0;
+        }
+        if (p[k] < low || p[k] > high) {
+            return -1;
+        }
+        cp = (cp << 6) | (p[k] & 0x3F);
+        low = 0x80;
+        high = 0xBF;
+    }
+    
+    *code_point = cp;
+    return len;
+}
+
+// ASCII replacement for a non-ASCII character, or NULL if there is none
+static const Transliteration *transliterate(uint32_t code_point) {
+    if (code_point >= LATIN_FIRST && code_point <= LATIN_LAST) {
+        const Transliteration *t = &latin_transliterations[code_point - LATIN_FIRST];
+        return t->text[0] ? t : NULL;
+    }
+    for (size_t i = 0; i < sizeof(typographic_transliterations) / sizeof(typographic_transliterations[0]); i++) {
+        if (typographic_transliterations[i].code_point == code_point) {
+            return &typographic_transliterations[i];
+        }
+    }
+    return NULL;
+}
+
+static result_t pattern_to_text(unsigned char pattern, char *output, size_t output_size) {
+    if (output == NULL || output_size < PATTERN_LENGTH + 1) {
+        return RESULT_ERROR_ARGS;
+    }
+    
+    output[0] = (pattern & 0x01) ? 'o' : '.';
+    output[1] = (pattern & 0x08) ? 'o' : '.';
+    output[2] = (pattern & 0x02) ? 'o' : '.';
+    output[3] = (pattern & 0x10) ? 'o' : '.';
+    output[4] = (pattern & 0x04) ? 'o' : '.';
+    output[5] = (pattern & 0x20) ? 'o' : '.';
+    output[6] = '\0';
+    
+    return RESULT_SUCCESS;
+}
+
+static unsigned char text_to_pattern(const char *text) {
+    if (text == NULL || strlen(text) < PATTERN_LENGTH) {
+        return 0;
+    }
+    
+    unsigned char pattern = 0;
+    if (text[0] == 'o') pattern |= 0x01;
+    if (text[1] == 'o') pattern |= 0x08;
+    if (text[2] == 'o') pattern |= 0x02;
+    if (text[3] == 'o') pattern |= 0x10;
+    if (text[4] == 'o') pattern |= 0x04;
+    if (text[5] == 'o') pattern |= 0x20;
+    
+    return pattern;
+}
+
+// Buffered output shared by both encode modes
+typedef struct {
+    FILE *stream;
+    size_t len;
+    char data[OUTPUT_BUFFER_SIZE];
+} out_buffer_t;
+
+static result_t out_flush(out_buffer_t *out) {
+    if (out->len > 0 && fwrite(out->data, 1, out->len, out->stream) != out->len) {
+        return RESULT_ERROR_IO;
+    }
+    out->len = 0;
+    return RESULT_SUCCESS;
+}
+
+// Make room for the largest single write (one text-mode cell and its terminator)
+static result_t out_reserve(out_buffer_t *out) {
+    if (out->len > sizeof(out->data) - (PATTERN_LENGTH + 1)) {
+        return out_flush(out);
+    }
+    return RESULT_SUCCESS;
+}
+
+static result_t write_byte(out_buffer_t *out, char c) {
+    result_t result = out_reserve(out);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    out->data[out->len++] = c;
+    return RESULT_SUCCESS;
+}
+
+// North American Braille ASCII, indexed by cell pattern
+static const char brf_ascii[64] =
+    " A1B'K2L@CIF/MSP\"E3H9O6R^DJG>NTQ,*5<-U8V.%[$+X!&;:4\\0Z7(_?W]#Y)=";
+
+// BRF page layout. Cells of the current word are held back until a space or
+// line end shows whether the word still fits on the line, so only one line's
+// worth of lookahead is ever buffered. The last line of every page carries
+// the braille page number, right-aligned.
+typedef struct {
+    unsigned char word[BRF_CELLS_PER_LINE];
+    size_t word_len;
+    size_t spaces;      // spaces waiting to be written before the next word
+    size_t column;      // cells already written on the current line
+    int line;           // lines already written on the current page
+    long page;
+} BrfLayout;
+
+static BrfLayout brf = { .page = 1 };
+
+static result_t brf_new_line(out_buffer_t *out) {
+    result_t result = write_byte(out, '\r');
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(out, '\n');
+    }
+    brf.column = 0;
+    brf.spaces = 0;
+    if (result != RESULT_SUCCESS || ++brf.line < BRF_LINES_PER_PAGE - 1) {
+        return result;
+    }
+    
+    // Page number line: number sign, then the digits as letters a-j
+    char number[24];
+    int digits = snprintf(number, sizeof(number), "%ld", brf.page);
+    for (int i = 0; i < BRF_CELLS_PER_LINE - digits - 1 && result == RESULT_SUCCESS; i++) {
+        result = write_byte(out, ' ');
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(out, brf_ascii[BRAILLE_NUMBER]);
+    }
+    for (int i = 0; i < digits && result == RESULT_SUCCESS; i++) {
+        result = write_byte(out, brf_ascii[char_to_braille(number[i])]);
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(out, '\r');
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(out, '\n');
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(out, '\f');
+    }
+    brf.line = 0;
+    brf.page++;
+    return result;
+}
+
+// Place the pending word, moving to a new line first if it does not fit
+static result_t brf_flush_word(out_buffer_t *out) {
+    result_t result = RESULT_SUCCESS;
+    
+    if (brf.word_len == 0) {
+        return RESULT_SUCCESS;
+    }
+    if (brf.column + brf.spaces + brf.word_len > BRF_CELLS_PER_LINE) {
+        result = brf_new_line(out);
+    }
+    for (; brf.spaces > 0 && result == RESULT_SUCCESS; brf.spaces--) {
+        result = write_byte(out, ' ');
+        brf.column++;
+    }
+    for (size_t i = 0; i < brf.word_len && result == RESULT_SUCCESS; i++) {
+        result = write_byte(out, brf_ascii[brf.word[i]]);
+    }
+    brf.column += brf.word_len;
+    brf.word_len = 0;
+    return result;
+}
+
+static result_t brf_cell(out_buffer_t *out, unsigned char pattern) {
+    pattern &= 0x3F;
+    if (pattern == 0x00) {
+        result_t result = brf_flush_word(out);
+        if (brf.column + brf.spaces < BRF_CELLS_PER_LINE) {
+            brf.spaces++;
+        }
+        return result;
+    }
+    
+    // A word longer than a line is broken at the margin
+    if (brf.word_len == BRF_CELLS_PER_LINE) {
+        result_t result = brf_flush_word(out);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+    }
+    brf.word[brf.word_len++] = pattern;
+    return RESULT_SUCCESS;
+}
+
+// Complete the current line, then pad out the last page so it gets its number
+static result_t brf_finish(out_buffer_t *out) {
+    result_t result = brf_flush_word(out);
+    if (result == RESULT_SUCCESS && brf.column > 0) {
+        result = brf_new_line(out);
+    }
+    while (result == RESULT_SUCCESS && brf.line > 0) {
+        result = brf_new_line(out);
+    }
+    return result;
+}
+
+// Dot bit for each grid row (dots 1-3 down the left column, 4-6 down the right)
+static const unsigned char grid_dots[3][2] = {
+    {0x01, 0x08},
+    {0x02, 0x10},
+    {0x04, 0x20}
+};
+
+// Grid layout. Each braille line is assembled as three rows of dots, one
+// cell wide at a time, in buffers that are reused for every line. A blank
+// line follows the last group of rows of each input line; wrapped groups
+// of the same line follow one another directly.
+typedef struct {
+    char *rows[3];
+    size_t capacity;
+    size_t len;         // bytes used in each row
+    long cells;         // cells in the current group of rows
+    long wrap_cells;    // 0 for no wrapping
+    int cell_width;     // bytes per cell: two dots and the gap after them
+} GridLayout;
+
+static GridLayout grid = { .wrap_cells = DEFAULT_WRAP_CELLS, .cell_width = DEFAULT_GRID_CELL_WIDTH };
+
+// Write the pending rows, without the gap after the last cell
+static result_t grid_flush_rows(out_buffer_t *out) {
+    size_t len = grid.len - (size_t)(grid.cell_width - 2);
+    result_t result = RESULT_SUCCESS;
+    
+    for (int r = 0; r < 3 && result == RESULT_SUCCESS; r++) {
+        for (size_t i = 0; i < len && result == RESULT_SUCCESS; i++) {
+            result = write_byte(out, grid.rows[r][i]);
+        }
+        if (result == RESULT_SUCCESS) {
+            result = write_byte(out, '\n');
+        }
+    }
+    grid.len = 0;
+    grid.cells = 0;
+    return result;
+}
+
+static result_t grid_cell(out_buffer_t *out, unsigned char pattern) {
+    if (grid.len + (size_t)grid.cell_width > grid.capacity) {
+        size_t capacity = grid.capacity ? grid.capacity * 2 : 64 * (size_t)grid.cell_width;
+        for (int r = 0; r < 3; r++) {
+            char *grown = realloc(grid.rows[r], capacity);
+            if (grown == NULL) {
+                return RESULT_ERROR_MEMORY;
+            }
+            grid.rows[r] = grown;
+        }
+        grid.capacity = capacity;
+    }
+    
+    // All three rows are filled from the one pattern
+    for (int r = 0; r < 3; r++) {
+        char *p = grid.rows[r] + grid.len;
+        p[0] = (pattern & grid_dots[r][0]) ? 'o' : '.';
+        p[1] = (pattern & grid_dots[r][1]) ? 'o' : '.';
+        memset(p + 2, ' ', (size_t)grid.cell_width - 2);
+    }
+    grid.len += (size_t)grid.cell_width;
+    
+    if (++grid.cells == grid.wrap_cells) {
+        return grid_flush_rows(out);
+    }
+    return RESULT_SUCCESS;
+}
+
+static result_t grid_end_line(out_buffer_t *out) {
+    result_t result = grid.cells > 0 ? grid_flush_rows(out) : RESULT_SUCCESS;
+    return result == RESULT_SUCCESS ? write_byte(out, '\n') : result;
+}
+
+static result_t grid_finish(out_buffer_t *out) {
+    result_t result = grid.cells > 0 ? grid_end_line(out) : RESULT_SUCCESS;
+    for (int r = 0; r < 3; r++) {
+        free(grid.rows[r]);
+        grid.rows[r] = NULL;
+    }
+    grid.capacity = 0;
+    return result;
+}
+
+static result_t write_pattern(out_buffer_t *out, unsigned char pattern, cell_format_t format) {
+    if (format == FORMAT_BRF) {
+        return brf_cell(out, pattern);
+    } else if (format == FORMAT_GRID) {
+        return grid_cell(out, pattern);
+    }
+    
+    result_t result = out_reserve(out);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    
+    char *p = out->data + out->len;
+    if (format == FORMAT_TEXT) {
+        pattern_to_text(pattern, p, PATTERN_LENGTH + 1);
+        out->len += PATTERN_LENGTH;
+    } else {
+        // U+2800 + pattern in UTF-8, independent of the locale
+        p[0] = (char)0xE2;
+        p[1] = (char)(0xA0 | (pattern >> 6));
+        p[2] = (char)(0x80 | (pattern & 0x3F));
+        out->len += 3;
+    }
+    
+    return RESULT_SUCCESS;
+}
+
+static result_t write_line_end(out_buffer_t *out, cell_format_t format) {
+    if (format == FORMAT_BRF) {
+        result_t result = brf_flush_word(out);
+        return result == RESULT_SUCCESS ? brf_new_line(out) : result;
+    } else if (format == FORMAT_GRID) {
+        return grid_end_line(out);
+    }
+    return write_byte(out, '\n');
+}
+
+// Terminate encoder output and flush it
+static result_t write_end(out_buffer_t *out, cell_format_t format) {
+    result_t result;
+    if (format == FORMAT_BRF) {
+        result = brf_finish(out);
+    } else if (format == FORMAT_GRID) {
+        result = grid_finish(out);
+    } else {
+        result = write_byte(out, '\n');
+    }
+    return result == RESULT_SUCCESS ? out_flush(out) : result;
+}
+
+// True when any byte of the word equals the byte replicated in pattern
+#define ONES_64 0x0101010101010101ULL
+#define HIGHS_64 0x8080808080808080ULL
+#define HAS_BYTE(word, pattern) ((((word) ^ (pattern)) - ONES_64) & ~((word) ^ (pattern)) & HIGHS_64)
+
+// End of the run of ASCII bytes starting at i. Eight bytes are tested per
+// step, so plain ASCII text never reaches the UTF-8 decoder.
+static size_t ascii_run(const unsigned char *p, size_t i, size_t len) {
+    while (i + 8 <= len) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        if (word & HIGHS_64) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < len && p[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Grade 1 encoder state carried across characters
+typedef struct {
+    out_buffer_t *out;
+    cell_format_t format;
+    int number_mode;
+    size_t line_length;
+} Grade1Encoder;
+
+// Emit one ASCII character with its number, capital and accent signs
+static result_t grade1_char(Grade1Encoder *e, int c, accent_t accent) {
+    result_t result;
+    
+    if (c == '\n') {
+        e->number_mode = 0;
+        e->line_length = 0;
+        return write_line_end(e->out, e->format);
+    }
+    
+    // Prevent extremely long lines
+    if (e->line_length > MAX_LINE_LENGTH) {
+        fprintf(stderr, "Warning: line too long, truncating\n");
+        return RESULT_SUCCESS;
+    }
+    
+    unsigned char pattern = char_to_braille((char)c);
+    if (pattern == 0xFF) {
+        if (isprint(c)) {
+            fprintf(stderr, "Warning: skipping unsupported character '%c'\n", c);
+        } else {
+            fprintf(stderr, "Warning: skipping unsupported character (0x%02X)\n", (unsigned char)c);
+        }
+        return RESULT_SUCCESS;
+    }
+    
+    // Handle numbers
+    if (isdigit(c) && !e->number_mode) {
+        result = write_pattern(e->out, BRAILLE_NUMBER, e->format);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+        e->number_mode = 1;
+        e->line_length++;
+    } else if (!isdigit(c) && c != ' ') {
+        e->number_mode = 0;
+    }
+    
+    // Handle capital letters
+    if (isupper(c) && isalpha(c)) {
+        result = write_pattern(e->out, BRAILLE_CAPITAL, e->format);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+        e->line_length++;
+    }
+    
+    // Accent indicator
+    for (int k = 0; k < 2 && accent_cells[accent][0]; k++) {
+        result = write_pattern(e->out, accent_cells[accent][k], e->format);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+        e->line_length++;
+    }
+    
+    // Write character pattern
+    result = write_pattern(e->out, pattern, e->format);
+    if (result == RESULT_SUCCESS) {
+        e->line_length++;
+    }
+    return result;
+}
+
+// Emit a non-ASCII character through the transliteration tables
+static result_t grade1_code_point(Grade1Encoder *e, uint32_t code_point) {
+    const Transliteration *t = transliterate(code_point);
+    if (t == NULL) {
+        fprintf(stderr, "Warning: skipping unsupported character U+%04X\n", (unsigned)code_point);
+        return RESULT_SUCCESS;
+    }
+    
+    result_t result = RESULT_SUCCESS;
+    for (int k = 0; t->text[k] && result == RESULT_SUCCESS; k++) {
+        result = grade1_char(e, t->text[k], k == 0 ? (accent_t)t->accent : ACCENT_NONE);
+    }
+    return result;
+}
+
+static result_t encode_braille(FILE *input, FILE *output, cell_format_t format) {
+    if (input == NULL || output == NULL) {
+        return RESULT_ERROR_ARGS;
+    }
+    
+    static out_buffer_t out;
+    unsigned char buffer[BUFFER_SIZE];
+    Grade1Encoder encoder = { &out, format, 0, 0 };
+    size_t carry = 0;
+    int at_eof = 0;
+    result_t result = RESULT_SUCCESS;
+    
+    out.stream = output;
+    out.len = 0;
+    
+    while (!at_eof && result == RESULT_SUCCESS) {
+        size_t want = sizeof(buffer) - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        size_t i = 0;
+        at_eof = bytes_read < want;
+        
+        while (i < len && result == RESULT_SUCCESS) {
+            size_t end = ascii_run(buffer, i, len);
+            for (; i < end && result == RESULT_SUCCESS; i++) {
+                result = grade1_char(&encoder, buffer[i], ACCENT_NONE);
+            }
+            if (i == len || result != RESULT_SUCCESS) {
+                break;
+            }
+            
+            uint32_t code_point;
+            int n = utf8_decode(buffer + i, len - i, at_eof, &code_point);
+            if (n == 0) {
+                break;      // sequence continues in the next read
+            } else if (n < 0) {
+                fprintf(stderr, "Warning: skipping invalid UTF-8 byte (0x%02X)\n", buffer[i]);
+                i++;
+            } else {
+                result = grade1_code_point(&encoder, code_point);
+                i += (size_t)n;
+            }
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+    }
+    
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        return RESULT_ERROR_IO;
+    }
+    
+    return write_end(&out, format);
+}
+
+// Skip to the next byte that can start a braille cell (0xE2) or end a line.
+// Eight bytes are tested per step; everything else is ignored in bulk.
+static size_t skip_to_cell(const unsigned char *p, size_t i, size_t len) {
+    const uint64_t lead = 0xE2 * ONES_64;
+    const uint64_t newline = '\n' * ONES_64;
+    
+    while (i + 8 <= len) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        if (HAS_BYTE(word, lead) || HAS_BYTE(word, newline)) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < len && p[i] != 0xE2 && p[i] != '\n') {
+        i++;
+    }
+    return i;
+}
+
+// Decode UTF-8 braille (U+2800-U+283F) byte by byte, independent of the
+// locale. The pattern is the low bits of the last two bytes of E2 A0 xx;
+// other characters are skipped.
+static result_t decode_unicode(FILE *input, FILE *output) {
+    static out_buffer_t out;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    int number_mode = 0;
+    int capital_next = 0;
+    size_t line_length = 0;
+    result_t result;
+    
+    out.stream = output;
+    out.len = 0;
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        int at_eof = bytes_read < want;
+        size_t i = 0;
+        
+        while (i < len) {
+            if (buffer[i] != 0xE2 && buffer[i] != '\n') {
+                i = skip_to_cell(buffer, i, len);
+                if (i == len) {
+                    break;
+                }
+            }
+            
+            if (buffer[i] == '\n') {
+                result = write_byte(&out, '\n');
+                if (result != RESULT_SUCCESS) {
+                    return result;
+                }
+                number_mode = 0;
+                capital_next = 0;
+                line_length = 0;
+                i++;
+                continue;
+            }
+            
+            if (len - i < 3 && !at_eof) {
+                break;  // Cell split across reads
+            }
+            if (len - i < 3 || (buffer[i + 1] & 0xFC) != 0xA0 || (buffer[i + 2] & 0xC0) != 0x80) {
+                i++;
+                continue;  // Some other character
+            }
+            unsigned char pattern = (unsigned char)(((buffer[i + 1] & 0x03) << 6) | (buffer[i + 2] & 0x3F));
+            i += 3;
+            
+            if (line_length > MAX_LINE_LENGTH) {
+                fprintf(stderr, "Warning: line too long, truncating\n");
+                continue;
+            }
+            if (pattern > 0x3F) {
+                continue;  // 8-dot cells have no meaning here
+            }
+            
+            if (pattern == BRAILLE_NUMBER) {
+                number_mode = 1;
+            } else if (pattern == BRAILLE_CAPITAL) {
+                capital_next = 1;
+            } else {
+                char decoded = braille_to_char(pattern, number_mode, capital_next);
+                result = write_byte(&out, decoded);
+                if (result != RESULT_SUCCESS) {
+                    return result;
+                }
+                if (!isdigit((unsigned char)decoded) && decoded != ' ') {
+                    number_mode = 0;
+                }
+                capital_next = 0;
+            }
+            line_length++;
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        return RESULT_ERROR_IO;
+    }
+    
+    result = write_byte(&out, '\n');
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    
+    return out_flush(&out);
+}
+
+// 8-dot cells for --binary: byte b is U+2800 + b, E2 (A0 + b / 64) (80 + b % 64)
+static unsigned char binary_cells[256][3];
+
+static void build_binary_cells(void) {
+    for (int b = 0; b < 256; b++) {
+        binary_cells[b][0] = 0xE2;
+        binary_cells[b][1] = (unsigned char)(0xA0 | (b >> 6));
+        binary_cells[b][2] = (unsigned char)(0x80 | (b & 0x3F));
+    }
+}
+
+// Encode arbitrary bytes one cell each, wrapping after wrap_cells cells
+static result_t encode_binary(FILE *input, FILE *output, long wrap_cells) {
+    static out_buffer_t out;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t bytes_read;
+    long col_count = 0;
+    result_t result;
+    
+    out.stream = output;
+    out.len = 0;
+    build_binary_cells();
+    
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        size_t i = 0;
+        while (i < bytes_read) {
+            // Cells that fit before the next line break and in the buffer
+            size_t n = bytes_read - i;
+            if (wrap_cells > 0 && n > (size_t)(wrap_cells - col_count)) {
+                n = (size_t)(wrap_cells - col_count);
+            }
+            size_t room = out.len + 4 <= sizeof(out.data) ? (sizeof(out.data) - out.len - 1) / 3 : 0;
+            if (room == 0) {
+                result = out_flush(&out);
+                if (result != RESULT_SUCCESS) {
+                    return result;
+                }
+                continue;
+            }
+            if (n > room) {
+                n = room;
+            }
+            
+            unsigned char *p = (unsigned char *)out.data + out.len;
+            for (size_t k = 0; k < n; k++) {
+                memcpy(p + 3 * k, binary_cells[buffer[i + k]], 3);
+            }
+            out.len += 3 * n;
+            i += n;
+            col_count += (long)n;
+            
+            if (wrap_cells > 0 && col_count == wrap_cells) {
+                out.data[out.len++] = '\n';
+                col_count = 0;
+            }
+        }
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        return RESULT_ERROR_IO;
+    }
+    
+    // Add final newline if we haven't wrapped
+    if (wrap_cells == 0 || col_count > 0) {
+        result = write_byte(&out, '\n');
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+    }
+    
+    return out_flush(&out);
+}
+
+// Decode --binary output: every 8-dot cell is one byte, all else is ignored
+static result_t decode_binary(FILE *input, FILE *output) {
+    static out_buffer_t out;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    result_t result;
+    
+    out.stream = output;
+    out.len = 0;
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        int at_eof = bytes_read < want;
+        size_t i = 0;
+        
+        while (i < len) {
+            // Runs of cells go straight into the output buffer
+            size_t room = sizeof(out.data) - out.len;
+            unsigned char *p = (unsigned char *)out.data + out.len;
+            size_t n = 0;
+            while (n < room && i + 3 <= len && buffer[i] == 0xE2 &&
+                   (buffer[i + 1] & 0xFC) == 0xA0 && (buffer[i + 2] & 0xC0) == 0x80) {
+                p[n++] = (unsigned char)(((buffer[i + 1] & 0x03) << 6) | (buffer[i + 2] & 0x3F));
+                i += 3;
+            }
+            out.len += n;
+            if (n == room) {
+                result = out_flush(&out);
+                if (result != RESULT_SUCCESS) {
+                    return result;
+                }
+                continue;
+            }
+            if (i == len) {
+                break;
+            }
+            
+            if (buffer[i] == 0xE2) {
+                if (len - i < 3 && !at_eof) {
+                    break;  // Cell split across reads
+                }
+                i++;    // Some other character
+            } else {
+                i = skip_to_cell(buffer, i + 1, len);
+            }
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        return RESULT_ERROR_IO;
+    }
+    
+    return out_flush(&out);
+}
+
+// Grade 2 (contracted) braille. Contractions are matched on lower case
+// letters; a capital sign may precede one that starts a word.
+#define BRAILLE_LETTER_SIGN 0x30
+#define MAX_WORD_LENGTH 256
+#define AC_MAX_STATES 512
+#define AC_ALPHABET 26
+
+typedef enum {
+    RULE_ANYWHERE,      // part of any word
+    RULE_WORD,          // whole word only
+    RULE_NOT_START      // anywhere except the start of a word
+} contraction_rule_t;
+
+typedef struct {
+    const char *text;
+    unsigned char pattern;
+    contraction_rule_t rule;
+} ContractionEntry;
+
+static const ContractionEntry contractions[] = {
+    // Groupsigns
+    {"and", 0x2F, RULE_ANYWHERE}, {"for", 0x3F, RULE_ANYWHERE}, {"of", 0x37, RULE_ANYWHERE},
+    {"the", 0x2E, RULE_ANYWHERE}, {"with", 0x3E, RULE_ANYWHERE}, {"ch", 0x21, RULE_ANYWHERE},
+    {"gh", 0x23, RULE_ANYWHERE}, {"sh", 0x29, RULE_ANYWHERE}, {"th", 0x39, RULE_ANYWHERE},
+    {"wh", 0x31, RULE_ANYWHERE}, {"ed", 0x2B, RULE_ANYWHERE}, {"er", 0x3B, RULE_ANYWHERE},
+    {"ou", 0x33, RULE_ANYWHERE}, {"ow", 0x2A, RULE_ANYWHERE}, {"st", 0x0C, RULE_ANYWHERE},
+    {"ar", 0x1C, RULE_ANYWHERE}, {"ing", 0x2C, RULE_NOT_START},
+    // Whole-word signs
+    {"but", 0x03, RULE_WORD}, {"can", 0x09, RULE_WORD}, {"do", 0x19, RULE_WORD},
+    {"every", 0x11, RULE_WORD}, {"from", 0x0B, RULE_WORD}, {"go", 0x1B, RULE_WORD},
+    {"have", 0x13, RULE_WORD}, {"just", 0x1A, RULE_WORD}, {"knowledge", 0x05, RULE_WORD},
+    {"like", 0x07, RULE_WORD}, {"more", 0x0D, RULE_WORD}, {"not", 0x1D, RULE_WORD},
+    {"people", 0x0F, RULE_WORD}, {"quite", 0x1F, RULE_WORD}, {"rather", 0x17, RULE_WORD},
+    {"so", 0x0E, RULE_WORD}, {"that", 0x1E, RULE_WORD}, {"us", 0x25, RULE_WORD},
+    {"very", 0x27, RULE_WORD}, {"will", 0x3A, RULE_WORD}, {"it", 0x2D, RULE_WORD},
+    {"you", 0x3D, RULE_WORD}, {"as", 0x35, RULE_WORD}, {"child", 0x21, RULE_WORD},
+    {"shall", 0x29, RULE_WORD}, {"this", 0x39, RULE_WORD}, {"which", 0x31, RULE_WORD},
+    {"out", 0x33, RULE_WORD}, {"still", 0x0C, RULE_WORD},
+    {NULL, 0, RULE_ANYWHERE}
+};
+
+// Grade 2 punctuation avoids the groupsign cells; prefix 0 means one cell
+typedef struct {
+    char character;
+    unsigned char prefix;
+    unsigned char pattern;
+} PunctuationEntry;
+
+static const PunctuationEntry grade2_punctuation[] = {
+    {'.', 0, 0x32}, {',', 0, 0x02}, {'?', 0, 0x26}, {'!', 0, 0x16}, {';', 0, 0x06},
+    {':', 0, 0x12}, {'-', 0, 0x24}, {'\'', 0, 0x04}, {'"', 0, 0x36}, {' ', 0, 0x00},
+    {'(', 0x10, 0x23}, {')', 0x10, 0x1C}, {'/', 0x38, 0x0C},
+    {'\0', 0, 0}
+};
+
+// Aho-Corasick automaton over the contraction texts, as a complete DFA
+typedef struct {
+    int16_t next[AC_MAX_STATES][AC_ALPHABET];
+    int16_t fail[AC_MAX_STATES];
+    int16_t match[AC_MAX_STATES];   // contraction ending here, -1 if none
+    int16_t dict[AC_MAX_STATES];    // nearest state on the fail chain with a match
+    int states;
+} ContractionMatcher;
+
+// Tables built by build_grade2
+typedef struct {
+    ContractionMatcher ac;
+    const PunctuationEntry *punctuation[256];   // by character
+    const char *groupsign[64];      // by cell, anywhere in a word
+    const char *wordsign[64];       // by cell, standing alone
+    char punct_single[64];
+    char punct_pair[64][64];        // by prefix and cell
+    unsigned char is_prefix[64];
+} Grade2Tables;
+
+static Grade2Tables grade2;
+
+static void build_grade2(void) {
+    ContractionMatcher *ac = &grade2.ac;
+    int16_t queue[AC_MAX_STATES];
+    int head = 0, tail = 0;
+    
+    memset(&grade2, 0, sizeof(grade2));
+    memset(ac->next, -1, sizeof(ac->next));
+    ac->match[0] = -1;
+    ac->states = 1;
+    
+    for (int i = 0; contractions[i].text; i++) {
+        const ContractionEntry *e = &contractions[i];
+        int state = 0;
+        
+        for (const char *t = e->text; *t; t++) {
+            int c = *t - 'a';
+            if (ac->next[state][c] < 0) {
+                ac->match[ac->states] = -1;
+                ac->next[state][c] = (int16_t)ac->states++;
+            }
+            state = ac->next[state][c];
+        }
+        ac->match[state] = (int16_t)i;
+        
+        if (e->rule == RULE_WORD) {
+            grade2.wordsign[e->pattern] = e->text;
+        } else {
+            grade2.groupsign[e->pattern] = e->text;
+        }
+    }
+    
+    // Breadth-first: fail links, dictionary links and missing transitions
+    for (int c = 0; c < AC_ALPHABET; c++) {
+        int16_t s = ac->next[0][c];
+        if (s < 0) {
+            ac->next[0][c] = 0;
+        } else {
+            ac->fail[s] = 0;
+            ac->dict[s] = -1;
+            queue[tail++] = s;
+        }
+    }
+    while (head < tail) {
+        int16_t s = queue[head++];
+        for (int c = 0; c < AC_ALPHABET; c++) {
+            int16_t t = ac->next[s][c];
+            int16_t f = ac->next[ac->fail[s]][c];
+            if (t < 0) {
+                ac->next[s][c] = f;
+            } else {
+                ac->fail[t] = f;
+                ac->dict[t] = ac->match[f] >= 0 ? f : ac->dict[f];
+                queue[tail++] = t;
+            }
+        }
+    }
+    
+    for (int i = 0; grade2_punctuation[i].character != '\0'; i++) {
+        const PunctuationEntry *p = &grade2_punctuation[i];
+        grade2.punctuation[(unsigned char)p->character] = p;
+        if (p->prefix) {
+            grade2.punct_pair[p->prefix][p->pattern] = p->character;
+            grade2.is_prefix[p->prefix] = 1;
+        } else {
+            grade2.punct_single[p->pattern] = p->character;
+        }
+    }
+}
+
+// Grade 2 encoder state carried across words
+typedef struct {
+    out_buffer_t *out;
+    cell_format_t format;
+    int number_mode;
+    char word[MAX_WORD_LENGTH];
+    size_t word_len;
+    int word_after_digit;   // word started right after a digit
+    int word_continues;     // word was split because it is too long
+    int after_accent;       // last character was an accented letter
+} Grade2Encoder;
+
+// Emit one letter, with a capital sign if needed
+static result_t grade2_letter(Grade2Encoder *g, char c, int letter_sign) {
+    result_t result = RESULT_SUCCESS;
+    unsigned char pattern = char_to_braille(c);
+    
+    if (letter_sign) {
+        result = write_pattern(g->out, BRAILLE_LETTER_SIGN, g->format);
+    }
+    if (result == RESULT_SUCCESS && isupper((unsigned char)c)) {
+        result = write_pattern(g->out, BRAILLE_CAPITAL, g->format);
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_pattern(g->out, pattern, g->format);
+    }
+    return result;
+}
+
+// Contraction whose text is word[start, start + len)
+static const ContractionEntry *contraction_at(const char *word, size_t start, size_t len) {
+    int state = 0;
+    for (size_t k = start; k < start + len; k++) {
+        state = grade2.ac.next[state][tolower((unsigned char)word[k]) - 'a'];
+    }
+    return &contractions[grade2.ac.match[state]];
+}
+
+// Contract and emit the pending word. For every start position the longest
+// contraction allowed there is found with one pass of the automaton, then
+// the word is covered greedily from the left.
+static result_t grade2_flush_word(Grade2Encoder *g) {
+    const ContractionMatcher *ac = &grade2.ac;
+    unsigned char best[MAX_WORD_LENGTH];
+    unsigned short upper[MAX_WORD_LENGTH + 1];  // capitals before i, not counting the first letter
+    size_t n = g->word_len;
+    int whole = !g->word_continues && !g->word_after_digit;
+    result_t result;
+    
+    if (n == 0) {
+        return RESULT_SUCCESS;
+    }
+    
+    upper[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        upper[i + 1] = (unsigned short)(upper[i] + (i > 0 && isupper((unsigned char)g->word[i])));
+    }
+    memset(best, 0, n);
+    
+    int state = 0;
+    for (size_t e = 0; e < n; e++) {
+        state = ac->next[state][tolower((unsigned char)g->word[e]) - 'a'];
+        for (int s = ac->match[state] >= 0 ? state : ac->dict[state]; s > 0; s = ac->dict[s]) {
+            const ContractionEntry *c = &contractions[ac->match[s]];
+            size_t len = strlen(c->text);
+            size_t start = e + 1 - len;
+            
+            // Only the first letter of a word may be a capital in a contraction
+            if ((c->rule == RULE_WORD && (!whole || start != 0 || e + 1 != n)) ||
+                (c->rule == RULE_NOT_START && start == 0) ||
+                upper[e + 1] != upper[start]) {
+                continue;
+            }
+            if (len > best[start]) {
+                best[start] = (unsigned char)len;
+            }
+        }
+    }
+    
+    // A lone groupsign that is also a word sign would read back as the word
+    if (best[0] == n && !g->word_continues) {
+        const ContractionEntry *c = contraction_at(g->word, 0, n);
+        if (c->rule != RULE_WORD && grade2.wordsign[c->pattern]) {
+            best[0] = 0;
+        }
+    }
+    
+    for (size_t i = 0; i < n;) {
+        if (best[i] > 1) {
+            result = RESULT_SUCCESS;
+            if (isupper((unsigned char)g->word[i])) {
+                result = write_pattern(g->out, BRAILLE_CAPITAL, g->format);
+            }
+            if (result == RESULT_SUCCESS) {
+                result = write_pattern(g->out, contraction_at(g->word, i, best[i])->pattern, g->format);
+            }
+            i += best[i];
+        } else {
+            // Letter sign where the letter would read as a digit or a word sign
+            unsigned char pattern = char_to_braille(g->word[i]);
+            int letter_sign = (i == 0 && g->word_after_digit && decode_digit[pattern]) ||
+                              (n == 1 && !g->word_continues && grade2.wordsign[pattern]);
+            result = grade2_letter(g, g->word[i], letter_sign);
+            i++;
+        }
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+    }
+    
+    g->word_len = 0;
+    g->word_continues = 0;
+    g->word_after_digit = 0;
+    return RESULT_SUCCESS;
+}
+
+// Feed one ASCII character to the Grade 2 encoder
+static result_t grade2_char(Grade2Encoder *g, int c) {
+    result_t result;
+    
+    if (isalpha(c)) {
+        if (g->word_len == MAX_WORD_LENGTH) {
+            // Very long word: emit what we have and carry on mid-word
+            result = grade2_flush_word(g);
+            if (result != RESULT_SUCCESS) {
+                return result;
+            }
+            g->word_continues = 1;
+        } else if (g->word_len == 0) {
+            g->word_after_digit = g->number_mode;
+            g->word_continues = g->after_accent;
+        }
+        g->word[g->word_len++] = (char)c;
+        g->number_mode = 0;
+        g->after_accent = 0;
+        return RESULT_SUCCESS;
+    }
+    
+    result = grade2_flush_word(g);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    g->after_accent = 0;
+    
+    if (c == '\n') {
+        g->number_mode = 0;
+        return write_line_end(g->out, g->format);
+    } else if (isdigit(c)) {
+        result = RESULT_SUCCESS;
+        if (!g->number_mode) {
+            result = write_pattern(g->out, BRAILLE_NUMBER, g->format);
+            g->number_mode = 1;
+        }
+        if (result == RESULT_SUCCESS) {
+            result = write_pattern(g->out, char_to_braille((char)c), g->format);
+        }
+        return result;
+    } else if (grade2.punctuation[c]) {
+        const PunctuationEntry *p = grade2.punctuation[c];
+        result = p->prefix ? write_pattern(g->out, p->prefix, g->format) : RESULT_SUCCESS;
+        if (result == RESULT_SUCCESS) {
+            result = write_pattern(g->out, p->pattern, g->format);
+        }
+        g->number_mode = 0;
+        return result;
+    }
+    
+    if (isprint(c)) {
+        fprintf(stderr, "Warning: skipping unsupported character '%c'\n", c);
+    } else {
+        fprintf(stderr, "Warning: skipping unsupported character (0x%02X)\n", (unsigned char)c);
+    }
+    return RESULT_SUCCESS;
+}
+
+// Feed a non-ASCII character through the transliteration tables. An
+// accented letter is written uncontracted, splitting the word around it.
+static result_t grade2_code_point(Grade2Encoder *g, uint32_t code_point) {
+    const Transliteration *t = transliterate(code_point);
+    result_t result = RESULT_SUCCESS;
+    
+    if (t == NULL) {
+        fprintf(stderr, "Warning: skipping unsupported character U+%04X\n", (unsigned)code_point);
+        return RESULT_SUCCESS;
+    }
+    if (t->accent == ACCENT_NONE || !accent_cells[t->accent][0]) {
+        for (int k = 0; t->text[k] && result == RESULT_SUCCESS; k++) {
+            result = grade2_char(g, t->text[k]);
+        }
+        return result;
+    }
+    
+    if (g->word_len > 0) {
+        g->word_continues = 1;
+        result = grade2_flush_word(g);
+    }
+    if (result == RESULT_SUCCESS && isupper((unsigned char)t->text[0])) {
+        result = write_pattern(g->out, BRAILLE_CAPITAL, g->format);
+    }
+    for (int k = 0; k < 2 && result == RESULT_SUCCESS; k++) {
+        result = write_pattern(g->out, accent_cells[t->accent][k], g->format);
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_pattern(g->out, char_to_braille(t->text[0]), g->format);
+    }
+    g->number_mode = 0;
+    g->after_accent = 1;
+    return result;
+}
+
+static result_t encode_grade2(FILE *input, FILE *output, cell_format_t format) {
+    static out_buffer_t out;
+    static Grade2Encoder encoder;
+    Grade2Encoder *g = &encoder;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    int at_eof = 0;
+    result_t result = RESULT_SUCCESS;
+    
+    out.stream = output;
+    out.len = 0;
+    memset(g, 0, sizeof(*g));
+    g->out = &out;
+    g->format = format;
+    build_grade2();
+    
+    while (!at_eof && result == RESULT_SUCCESS) {
+        size_t want = sizeof(buffer) - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        size_t i = 0;
+        at_eof = bytes_read < want;
+        
+        while (i < len && result == RESULT_SUCCESS) {
+            size_t end = ascii_run(buffer, i, len);
+            for (; i < end && result == RESULT_SUCCESS; i++) {
+                result = grade2_char(g, buffer[i]);
+            }
+            if (i == len || result != RESULT_SUCCESS) {
+                break;
+            }
+            
+            uint32_t code_point;
+            int n = utf8_decode(buffer + i, len - i, at_eof, &code_point);
+            if (n == 0) {
+                break;      // sequence continues in the next read
+            } else if (n < 0) {
+                fprintf(stderr, "Warning: skipping invalid UTF-8 byte (0x%02X)\n", buffer[i]);
+                i++;
+            } else {
+                result = grade2_code_point(g, code_point);
+                i += (size_t)n;
+            }
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+    }
+    
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        return RESULT_ERROR_IO;
+    }
+    
+    result = grade2_flush_word(g);
+    return result == RESULT_SUCCESS ? write_end(&out, format) : result;
+}
+
+// Append text to the output, capitalising its first letter if asked
+static result_t grade2_put(out_buffer_t *out, const char *text, int *capital_next) {
+    for (const char *t = text; *t; t++) {
+        char c = *t;
+        if (*capital_next && t == text) {
+            c = (char)toupper((unsigned char)c);
+        }
+        result_t result = write_byte(out, c);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+    }
+    *capital_next = 0;
+    return RESULT_SUCCESS;
+}
+
+// Decode one line of Grade 2 cells. A first pass marks the cells that end a
+// word (spaces, punctuation, numbers), so a word sign can be recognised by
+// looking at its neighbours.
+static result_t decode_grade2_line(out_buffer_t *out, const unsigned char *cells,
+                                   unsigned char *boundary, size_t n) {
+    int number_mode = 0;
+    
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = cells[i];
+        boundary[i] = 1;
+        
+        if (grade2.is_prefix[c] && i + 1 < n && grade2.punct_pair[c][cells[i + 1]]) {
+            boundary[++i] = 1;
+            number_mode = 0;
+        } else if (c == BRAILLE_NUMBER) {
+            number_mode = 1;
+        } else if (number_mode && decode_digit[c]) {
+            continue;
+        } else {
+            number_mode = 0;
+            boundary[i] = c == 0x00 || grade2.punct_single[c] != 0;
+        }
+    }
+    
+    int capital_next = 0;
+    int letter_next = 0;
+    char single[2] = {0, 0};
+    result_t result = RESULT_SUCCESS;
+    number_mode = 0;
+    
+    for (size_t i = 0; i < n && result == RESULT_SUCCESS; i++) {
+        unsigned char c = cells[i];
+        const char *text = NULL;
+        
+        if (grade2.is_prefix[c] && i + 1 < n && grade2.punct_pair[c][cells[i + 1]]) {
+            single[0] = grade2.punct_pair[c][cells[++i]];
+            text = single;
+            number_mode = 0;
+        } else if (c == BRAILLE_NUMBER) {
+            number_mode = 1;
+            continue;
+        } else if (number_mode && decode_digit[c]) {
+            single[0] = decode_digit[c];
+            text = single;
+        } else if (c == BRAILLE_CAPITAL) {
+            capital_next = 1;
+            number_mode = 0;
+            continue;
+        } else if (c == BRAILLE_LETTER_SIGN) {
+            letter_next = 1;
+            number_mode = 0;
+            continue;
+        } else {
+            size_t prev = i;
+            if (prev > 0 && cells[prev - 1] == BRAILLE_CAPITAL) {
+                prev--;
+            }
+            int alone = (prev == 0 || boundary[prev - 1]) && (i + 1 == n || boundary[i + 1]);
+            
+            number_mode = 0;
+            if (letter_next && isalpha((unsigned char)decode_lower[c])) {
+                single[0] = decode_lower[c];
+                text = single;
+            } else if (alone && grade2.wordsign[c]) {
+                text = grade2.wordsign[c];
+            } else if (grade2.groupsign[c]) {
+                text = grade2.groupsign[c];
+            } else if (isalpha((unsigned char)decode_lower[c])) {
+                single[0] = decode_lower[c];
+                text = single;
+            } else if (grade2.punct_single[c] || c == 0x00) {
+                single[0] = grade2.punct_single[c];
+                text = single;
+            } else {
+                single[0] = '?';
+                text = single;
+            }
+        }
+        
+        letter_next = 0;
+        result = grade2_put(out, text, &capital_next);
+    }
+    
+    return result;
+}
+
+// Decode Grade 2 braille line by line, from Unicode cells or the text form
+static result_t decode_grade2(FILE *input, FILE *output, int text_mode) {
+    static out_buffer_t out;
+    char *line = NULL;
+    size_t line_cap = 0;
+    unsigned char *cells = NULL;
+    size_t cells_cap = 0;
+    ssize_t line_len;
+    result_t result = RESULT_SUCCESS;
+    
+    out.stream = output;
+    out.len = 0;
+    build_grade2();
+    
+    while (result == RESULT_SUCCESS && (line_len = getline(&line, &line_cap, input)) != -1) {
+        const unsigned char *p = (const unsigned char *)line;
+        size_t len = (size_t)line_len;
+        int has_newline = len > 0 && p[len - 1] == '\n';
+        size_t n = 0;
+        
+        // A line holds at most one cell per byte; the second half marks boundaries
+        if (len * 2 > cells_cap) {
+            unsigned char *grown = realloc(cells, len * 2);
+            if (grown == NULL) {
+                result = RESULT_ERROR_MEMORY;
+                break;
+            }
+            cells = grown;
+            cells_cap = len * 2;
+        }
+        
+        if (text_mode) {
+            char group[PATTERN_LENGTH + 1];
+            int pos = 0;
+            for (size_t i = 0; i < len; i++) {
+                if (p[i] == 'o' || p[i] == '.') {
+                    group[pos++] = (char)p[i];
+                    if (pos == PATTERN_LENGTH) {
+                        group[pos] = '\0';
+                        cells[n++] = text_to_pattern(group);
+                        pos = 0;
+                    }
+                }
+            }
+        } else {
+            for (size_t i = 0; i + 3 <= len; i++) {
+                if (p[i] == 0xE2 && p[i + 1] == 0xA0 && (p[i + 2] & 0xC0) == 0x80) {
+                    cells[n++] = p[i + 2] & 0x3F;
+                    i += 2;
+                }
+            }
+        }
+        
+        result = decode_grade2_line(&out, cells, cells + len, n);
+        if (result == RESULT_SUCCESS && has_newline) {
+            result = write_byte(&out, '\n');
+        }
+    }
+    
+    if (result == RESULT_SUCCESS && ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        result = RESULT_ERROR_IO;
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(&out, '\n');
+    }
+    if (result == RESULT_SUCCESS) {
+        result = out_flush(&out);
+    }
+    
+    free(line);
+    free(cells);
+    return result;
+}
+
+// Decode one line of Grade 1 cells with the rules of the text form
+static result_t decode_grade1_line(out_buffer_t *out, const unsigned char *cells, size_t n) {
+    int number_mode = 0;
+    int capital_next = 0;
+    
+    for (size_t i = 0; i < n; i++) {
+        if (cells[i] == BRAILLE_NUMBER) {
+            number_mode = 1;
+        } else if (cells[i] == BRAILLE_CAPITAL) {
+            capital_next = 1;
+        } else {
+            char decoded = braille_to_char(cells[i], number_mode, capital_next);
+            result_t result = write_byte(out, decoded);
+            if (result != RESULT_SUCCESS) {
+                return result;
+            }
+            if (!isdigit((unsigned char)decoded) && decoded != ' ') {
+                number_mode = 0;
+            }
+            capital_next = 0;
+        }
+    }
+    
+    return RESULT_SUCCESS;
+}
+
+// Read the cells of one group of grid rows. The three rows are walked in
+// lockstep, two dots from each per cell; gaps of any width are skipped.
+static size_t grid_scan_rows(char *const rows[3], unsigned char *cells) {
+    const char *p[3] = {rows[0], rows[1], rows[2]};
+    size_t n = 0;
+    
+    for (;;) {
+        unsigned char pattern = 0;
+        for (int r = 0; r < 3; r++) {
+            for (int col = 0; col < 2; col++) {
+                while (*p[r] != '\0' && *p[r] != 'o' && *p[r] != '.') {
+                    p[r]++;
+                }
+                if (*p[r] == '\0') {
+                    return n;
+                }
+                if (*p[r]++ == 'o') {
+                    pattern |= grid_dots[r][col];
+                }
+            }
+        }
+        cells[n++] = pattern;
+    }
+}
+
+// Decode the grid form: groups of three rows, with a blank line ending each
+// braille line
+static result_t decode_grid(FILE *input, FILE *output, int grade2_mode) {
+    static out_buffer_t out;
+    char *rows[3] = {NULL, NULL, NULL};
+    size_t row_caps[3] = {0, 0, 0};
+    int pending = 0;
+    unsigned char *cells = NULL;
+    size_t cells_len = 0;
+    size_t cells_cap = 0;
+    ssize_t line_len;
+    result_t result = RESULT_SUCCESS;
+    
+    out.stream = output;
+    out.len = 0;
+    if (grade2_mode) {
+        build_grade2();
+    }
+    
+    while (result == RESULT_SUCCESS) {
+        line_len = getline(&rows[pending], &row_caps[pending], input);
+        int blank = line_len == -1 || strcspn(rows[pending], "o.") == (size_t)line_len;
+        
+        if (!blank && ++pending == 3) {
+            // A group holds at most one cell per two bytes of its first row;
+            // the second half of the buffer marks Grade 2 word boundaries
+            size_t need = cells_len + row_caps[0] / 2 + 1;
+            if (need * 2 > cells_cap) {
+                unsigned char *grown = realloc(cells, need * 2);
+                if (grown == NULL) {
+                    result = RESULT_ERROR_MEMORY;
+                    break;
+                }
+                cells = grown;
+                cells_cap = need * 2;
+            }
+            cells_len += grid_scan_rows(rows, cells + cells_len);
+            pending = 0;
+        } else if (blank) {
+            if (pending > 0) {
+                fprintf(stderr, "Warning: skipping incomplete group of %d grid rows\n", pending);
+                pending = 0;
+            }
+            if (line_len == -1 && cells_len == 0) {
+                break;
+            }
+            if (grade2_mode) {
+                result = decode_grade2_line(&out, cells, cells + cells_cap / 2, cells_len);
+            } else {
+                result = decode_grade1_line(&out, cells, cells_len);
+            }
+            if (result == RESULT_SUCCESS && line_len != -1) {
+                result = write_byte(&out, '\n');
+            }
+            cells_len = 0;
+            if (line_len == -1) {
+                break;
+            }
+        }
+    }
+    
+    if (result == RESULT_SUCCESS && ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
+        result = RESULT_ERROR_IO;
+    }
+    if (result == RESULT_SUCCESS) {
+        result = write_byte(&out, '\n');
+    }
+    if (result == RESULT_SUCCESS) {
+        result = out_flush(&out);
+    }
+    
+    for (int r = 0; r < 3; r++) {
+        free(rows[r]);
+    }
+    free(cells);
+    return result;
+}
+
+// Loadable translation tables in the liblouis text format. Character
+// definitions and contractions are compiled into a byte-level trie, which
+// is the deterministic automaton used for longest-match translation. The
+// compiled form is laid out as flat arrays so that it can be written to a
+// cache file and mapped back in directly on later runs.
+#define MAX_RULE_CELLS 30
+#define MAX_RULE_TEXT 255
+#define MAX_TABLE_INCLUDE_DEPTH 16
+#define TABLE_CACHE_SUFFIX ".cache"
+#define TABLE_CACHE_MAGIC "BRLTAB\0\1"
+#define TABLE_NO_RULE UINT32_MAX
+
+// Rule kinds, in the order they are preferred when several rules have the
+// same text: the more context a rule demands, the earlier it is tried
+typedef enum {
+    TABLE_WORD = 0,
+    TABLE_BEGWORD,
+    TABLE_ENDWORD,
+    TABLE_MIDWORD,
+    TABLE_PARTWORD,
+    TABLE_ALWAYS,
+    TABLE_CHAR,
+    TABLE_LETTER,
+    TABLE_UPPERCASE,
+    TABLE_DIGIT
+} table_opcode_t;
+
+static const struct {
+    const char *name;
+    table_opcode_t opcode;
+} table_opcodes[] = {
+    {"word", TABLE_WORD},
+    {"lowword", TABLE_WORD},
+    {"joinword", TABLE_WORD},
+    {"contraction", TABLE_WORD},
+    {"begword", TABLE_BEGWORD},
+    {"endword", TABLE_ENDWORD},
+    {"midword", TABLE_MIDWORD},
+    {"partword", TABLE_PARTWORD},
+    {"always", TABLE_ALWAYS},
+    {"largesign", TABLE_ALWAYS},
+    {"space", TABLE_CHAR},
+    {"punctuation", TABLE_CHAR},
+    {"sign", TABLE_CHAR},
+    {"math", TABLE_CHAR},
+    {"letter", TABLE_LETTER},
+    {"lowercase", TABLE_LETTER},
+    {"uppercase", TABLE_UPPERCASE},
+    {"digit", TABLE_DIGIT},
+    {"litdigit", TABLE_DIGIT}
+};
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t cell_count;
+    uint8_t cells[MAX_RULE_CELLS];
+} TableRule;
+
+typedef struct {
+    uint32_t first_edge;
+    uint32_t first_rule;
+    uint16_t edge_count;
+    uint16_t rule_count;
+} TableState;
+
+typedef struct {
+    uint32_t target;
+    uint8_t byte;
+    uint8_t padding[3];
+} TableEdge;
+
+// A compiled table. The arrays point into one block, either allocated or
+// mapped from the cache file, in this order: root transitions, word bytes,
+// states, edges, rules.
+typedef struct {
+    const uint32_t *root;           // state after each first byte, 0 for none
+    const uint8_t *word_byte;       // bytes that belong to words
+    const TableState *states;
+    const TableEdge *edges;
+    const TableRule *rules;
+    uint32_t state_count;
+    uint32_t edge_count;
+    uint32_t rule_count;
+    uint32_t max_text_len;
+    TableRule capsletter;           // cell_count 0 when the table has none
+    TableRule numsign;
+    void *memory;
+    size_t memory_size;
+    int mapped;
+} TranslationTable;
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t source_count;
+    uint32_t sources_size;
+    uint32_t state_count;
+    uint32_t edge_count;
+    uint32_t rule_count;
+    uint32_t max_text_len;
+    TableRule capsletter;
+    TableRule numsign;
+} TableCacheHeader;
+
+// One source file of a cached table, followed by its path and padding
+typedef struct {
+    int64_t mtime;
+    int64_t size;
+    uint32_t path_len;
+    uint32_t padding;
+} TableCacheSource;
+
+static TranslationTable table;
+
+#define ALIGN_8(n) (((n) + 7) & ~(size_t)7)
+
+static size_t table_body_size(uint32_t states, uint32_t edges, uint32_t rules) {
+    return 256 * sizeof(uint32_t) + 256 + states * sizeof(TableState) +
+           edges * sizeof(TableEdge) + rules * sizeof(TableRule);
+}
+
+static void table_set_arrays(TranslationTable *t, const unsigned char *body) {
+    t->root = (const uint32_t *)body;
+    t->word_byte = body + 256 * sizeof(uint32_t);
+    t->states = (const TableState *)(t->word_byte + 256);
+    t->edges = (const TableEdge *)(t->states + t->state_count);
+    t->rules = (const TableRule *)(t->edges + t->edge_count);
+}
+
+// Trie under construction. Children are kept in sibling lists sorted by
+// byte, so flattening them gives sorted edge ranges.
+typedef struct {
+    uint32_t child;         // 0 for none: the root is never a child
+    uint32_t sibling;
+    uint32_t rules;         // first rule, TABLE_NO_RULE for none
+    uint8_t byte;
+} BuildNode;
+
+typedef struct {
+    uint32_t rule;
+    char *text;
+    size_t text_len;
+} PendingEquals;
+
+typedef struct {
+    BuildNode *nodes;
+    size_t node_count;
+    size_t node_cap;
+    TableRule *rules;
+    uint32_t *rule_next;
+    size_t rule_count;
+    size_t rule_cap;
+    size_t rule_next_cap;
+    PendingEquals *equals;
+    size_t equals_count;
+    size_t equals_cap;
+    char **sources;
+    size_t source_count;
+    size_t source_cap;
+    uint8_t word_byte[256];
+    uint32_t max_text_len;
+    TableRule capsletter;
+    TableRule numsign;
+} TableBuilder;
+
+// Grow an array to hold at least need elements
+static int grow_array(void **array, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) {
+        return 1;
+    }
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    void *grown = realloc(*array, new_cap * size);
+    if (grown == NULL) {
+        return 0;
+    }
+    *array = grown;
+    *cap = new_cap;
+    return 1;
+}
+
+static uint32_t builder_child(TableBuilder *b, uint32_t node, uint8_t byte) {
+    uint32_t prev = 0;
+    uint32_t c = b->nodes[node].child;
+    while (c && b->nodes[c].byte < byte) {
+        prev = c;
+        c = b->nodes[c].sibling;
+    }
+    if (c && b->nodes[c].byte == byte) {
+        return c;
+    }
+    
+    if (b->node_count >= UINT32_MAX ||
+        !grow_array((void **)&b->nodes, &b->node_cap, b->node_count + 1, sizeof(BuildNode))) {
+        return 0;
+    }
+    uint32_t created = (uint32_t)b->node_count++;
+    BuildNode *n = &b->nodes[created];
+    n->child = 0;
+    n->sibling = c;
+    n->rules = TABLE_NO_RULE;
+    n->byte = byte;
+    if (prev) {
+        b->nodes[prev].sibling = created;
+    } else {
+        b->nodes[node].child = created;
+    }
+    return created;
+}
+
+// Add a rule for text, whose ASCII capitals are folded; capitals in the
+// input are found by the translator instead
+static result_t builder_add(TableBuilder *b, const char *text, size_t len, const TableRule *rule, uint32_t *index) {
+    uint32_t node = 0;
+    for (size_t k = 0; k < len; k++) {
+        node = builder_child(b, node, (uint8_t)tolower((unsigned char)text[k]));
+        if (node == 0) {
+            return RESULT_ERROR_MEMORY;
+        }
+    }
+    
+    if (!grow_array((void **)&b->rules, &b->rule_cap, b->rule_count + 1, sizeof(TableRule)) ||
+        !grow_array((void **)&b->rule_next, &b->rule_next_cap, b->rule_count + 1, sizeof(uint32_t))) {
+        return RESULT_ERROR_MEMORY;
+    }
+    
+    uint32_t r = (uint32_t)b->rule_count++;
+    b->rules[r] = *rule;
+    b->rule_next[r] = TABLE_NO_RULE;
+    
+    // Keep definition order within the node
+    uint32_t *link = &b->nodes[node].rules;
+    while (*link != TABLE_NO_RULE) {
+        link = &b->rule_next[*link];
+    }
+    *link = r;
+    
+    if (len > b->max_text_len) {
+        b->max_text_len = (uint32_t)len;
+    }
+    if (index != NULL) {
+        *index = r;
+    }
+    return RESULT_SUCCESS;
+}
+
+// Parse the characters operand, with the liblouis escapes, into UTF-8
+static int parse_table_chars(const char *s, char *out, size_t *len) {
+    size_t n = 0;
+    
+    while (*s) {
+        uint32_t cp = (unsigned char)*s++;
+        if (cp == '\\' && *s) {
+            int digits = 0;
+            switch (*s++) {
+                case 's': cp = ' '; break;
+                case 't': cp = '\t'; break;
+                case 'n': cp = '\n'; break;
+                case 'r': cp = '\r'; break;
+                case 'f': cp = '\f'; break;
+                case 'e': cp = 0x1B; break;
+                case '\\': cp = '\\'; break;
+                case 'x': digits = 4; break;
+                case 'y': digits = 5; break;
+                case 'z': digits = 8; break;
+                default: return 0;
+            }
+            if (digits) {
+                cp = 0;
+                for (int k = 0; k < digits; k++, s++) {
+                    if (!isxdigit((unsigned char)*s)) {
+                        return 0;
+                    }
+                    cp = cp * 16 + (uint32_t)(isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+                }
+                if (cp > 0x10FFFF) {
+                    return 0;
+                }
+            }
+        } else if (cp >= 0x80) {
+            // Already UTF-8: copy the byte as it is
+            if (n == MAX_RULE_TEXT) {
+                return 0;
+            }
+            out[n++] = (char)cp;
+            continue;
+        }
+    
+        char utf8[4];
+        size_t k = 0;
+        if (cp < 0x80) {
+            utf8[k++] = (char)cp;
+        } else if (cp < 0x800) {
+            utf8[k++] = (char)(0xC0 | (cp >> 6));
+            utf8[k++] = (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            utf8[k++] = (char)(0xE0 | (cp >> 12));
+            utf8[k++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            utf8[k++] = (char)(0x80 | (cp & 0x3F));
+        } else {
+            utf8[k++] = (char)(0xF0 | (cp >> 18));
+            utf8[k++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            utf8[k++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            utf8[k++] = (char)(0x80 | (cp & 0x3F));
+        }
+        if (n + k > MAX_RULE_TEXT) {
+            return 0;
+        }
+        memcpy(out + n, utf8, k);
+        n += k;
+    }
+    
+    *len = n;
+    return n > 0;
+}
+
+// Parse a dots operand such as 1-25-3456; "0" is the blank cell
+static int parse_table_dots(const char *s, TableRule *rule) {
+    rule->cell_count = 0;
+    
+    while (*s) {
+        unsigned char cell = 0;
+        const char *start = s;
+        for (; *s && *s != '-'; s++) {
+            if (*s == '0' && s == start && (s[1] == '\0' || s[1] == '-')) {
+                continue;
+            }
+            if (*s < '1' || *s > '8') {
+                return 0;
+            }
+            cell |= (unsigned char)(1 << (*s - '1'));
+        }
+        if (s == start || rule->cell_count == MAX_RULE_CELLS) {
+            return 0;
+        }
+        rule->cells[rule->cell_count++] = cell;
+        if (*s == '-') {
+            s++;
+            if (*s == '\0') {
+                return 0;
+            }
+        }
+    }
+    
+    return rule->cell_count > 0;
+}
+
+static result_t parse_table_file(TableBuilder *b, const char *path, int depth);
+
+// Compile one line of a table file
+static result_t parse_table_line(TableBuilder *b, char *line, const char *path, size_t line_number, int depth) {
+    char *save = NULL;
+    char *opcode = strtok_r(line, " \t\r\n", &save);
+    
+    if (opcode == NULL || opcode[0] == '#') {
+        return RESULT_SUCCESS;
+    }
+    
+    // Rules kept for back-translation only do not apply here
+    if (strcmp(opcode, "noback") == 0 || strcmp(opcode, "nofor") == 0) {
+        int skip = opcode[2] == 'f';
+        opcode = strtok_r(NULL, " \t\r\n", &save);
+        if (skip || opcode == NULL) {
+            return RESULT_SUCCESS;
+        }
+    }
+    
+    char *first = strtok_r(NULL, " \t\r\n", &save);
+    char *second = strtok_r(NULL, " \t\r\n", &save);
+    
+    if (strcmp(opcode, "include") == 0) {
+        if (first == NULL) {
+            fprintf(stderr, "Warning: %s:%zu: include without a file name\n", path, line_number);
+            return RESULT_SUCCESS;
+        }
+    
+        // Relative includes are found next to the including table
+        const char *slash = strrchr(path, '/');
+        size_t dir_len = first[0] != '/' && slash ? (size_t)(slash - path + 1) : 0;
+        char *included = malloc(dir_len + strlen(first) + 1);
+        if (included == NULL) {
+            return RESULT_ERROR_MEMORY;
+        }
+        memcpy(included, path, dir_len);
+        strcpy(included + dir_len, first);
+        result_t result = parse_table_file(b, included, depth + 1);
+        free(included);
+        return result;
+    }
+    
+    if (strcmp(opcode, "capsletter") == 0 || strcmp(opcode, "capsign") == 0 || strcmp(opcode, "numsign") == 0) {
+        TableRule *sign = opcode[0] == 'n' ? &b->numsign : &b->capsletter;
+        if (first == NULL || !parse_table_dots(first, sign)) {
+            fprintf(stderr, "Warning: %s:%zu: invalid dots for %s\n", path, line_number, opcode);
+            sign->cell_count = 0;
+        }
+        return RESULT_SUCCESS;
+    }
+    
+    size_t k;
+    for (k = 0; k < sizeof(table_opcodes) / sizeof(table_opcodes[0]); k++) {
+        if (strcmp(opcode, table_opcodes[k].name) == 0) {
+            break;
+        }
+    }
+    if (k == sizeof(table_opcodes) / sizeof(table_opcodes[0])) {
+        return RESULT_SUCCESS;      // opcodes for features this tool does not have
+    }
+    
+    TableRule rule;
+    char text[MAX_RULE_TEXT];
+    size_t text_len;
+    int equals = second != NULL && strcmp(second, "=") == 0;
+    
+    memset(&rule, 0, sizeof(rule));
+    rule.opcode = (uint8_t)table_opcodes[k].opcode;
+    if (first == NULL || second == NULL || !parse_table_chars(first, text, &text_len) ||
+        (!equals && !parse_table_dots(second, &rule))) {
+        fprintf(stderr, "Warning: %s:%zu: skipping malformed %s rule\n", path, line_number, opcode);
+        return RESULT_SUCCESS;
+    }
+    
+    // ASCII capitals are folded, so they are told apart by the input instead
+    if (rule.opcode == TABLE_UPPERCASE && (unsigned char)text[0] < 0x80) {
+        rule.opcode = TABLE_LETTER;
+    }
+    if ((rule.opcode == TABLE_LETTER || rule.opcode == TABLE_UPPERCASE) && text_len == 1) {
+        b->word_byte[(unsigned char)tolower((unsigned char)text[0])] = 1;
+        b->word_byte[(unsigned char)toupper((unsigned char)text[0])] = 1;
+    }
+    
+    uint32_t index;
+    result_t result = builder_add(b, text, text_len, &rule, &index);
+    if (result != RESULT_SUCCESS || !equals) {
+        return result;
+    }
+    
+    // "=" takes the dots of each character's definition once all are known
+    if (!grow_array((void **)&b->equals, &b->equals_cap, b->equals_count + 1, sizeof(PendingEquals))) {
+        return RESULT_ERROR_MEMORY;
+    }
+    PendingEquals *pending = &b->equals[b->equals_count];
+    pending->text = malloc(text_len);
+    if (pending->text == NULL) {
+        return RESULT_ERROR_MEMORY;
+    }
+    memcpy(pending->text, text, text_len);
+    pending->text_len = text_len;
+    pending->rule = index;
+    b->equals_count++;
+    return RESULT_SUCCESS;
+}
+
+static result_t parse_table_file(TableBuilder *b, const char *path, int depth) {
+    if (depth > MAX_TABLE_INCLUDE_DEPTH) {
+        fprintf(stderr, "Error: tables included too deeply at '%s'\n", path);
+        return RESULT_ERROR_FILE;
+    }
+    
+    FILE *file = fopen(path, "r");
+    char *resolved = file ? realpath(path, NULL) : NULL;
+    if (file == NULL || resolved == NULL) {
+        fprintf(stderr, "Error opening table '%s': %s\n", path, strerror(errno));
+        if (file != NULL) {
+            fclose(file);
+        }
+        return RESULT_ERROR_FILE;
+    }
+    
+    // Remember every file read, so the cache can tell when it is stale
+    if (!grow_array((void **)&b->sources, &b->source_cap, b->source_count + 1, sizeof(char *))) {
+        free(resolved);
+        fclose(file);
+        return RESULT_ERROR_MEMORY;
+    }
+    b->sources[b->source_count++] = resolved;
+    
+    char *line = NULL;
+    size_t line_cap = 0;
+    size_t line_number = 0;
+    result_t result = RESULT_SUCCESS;
+    
+    while (result == RESULT_SUCCESS && getline(&line, &line_cap, file) != -1) {
+        result = parse_table_line(b, line, path, ++line_number, depth);
+    }
+    if (result == RESULT_SUCCESS && ferror(file)) {
+        fprintf(stderr, "Error reading table '%s'\n", path);
+        result = RESULT_ERROR_FILE;
+    }
+    
+    free(line);
+    fclose(file);
+    return result;
 }
 
-static unsigned char char_to_braille(char c) {
-    char upper_c = (char)toupper((unsigned char)c);
-    for (size_t i = 0; braille_table[i].character != '\0'; i++) {
-        if (braille_table[i].character == upper_c) {
-            return braille_table[i].pattern;
+// Find the character definition for text[0, len)
+static const TableRule *builder_char_rule(const TableBuilder *b, const char *text, size_t len) {
+    uint32_t node = 0;
+    for (size_t k = 0; k < len; k++) {
+        uint8_t byte = (uint8_t)tolower((unsigned char)text[k]);
+        for (node = b->nodes[node].child; node && b->nodes[node].byte != byte; node = b->nodes[node].sibling) {
+        }
+        if (node == 0) {
+            return NULL;
+        }
+    }
+    for (uint32_t r = b->nodes[node].rules; r != TABLE_NO_RULE; r = b->rule_next[r]) {
+        if (b->rules[r].opcode >= TABLE_CHAR && b->rules[r].cell_count > 0) {
+            return &b->rules[r];
         }
     }
-    return 0xFF;
+    return NULL;
 }
 
-static char braille_to_char(unsigned char pattern, int is_number, int is_capital) {
-    for (size_t i = 0; braille_table[i].character != '\0'; i++) {
-        if (braille_table[i].pattern == pattern) {
-            char c = braille_table[i].character;
-            if (is_number && c >= 'A' && c <= 'J') {
-                return (c == 'J') ? '0' : ('1' + (c - 'A'));
+static void builder_resolve_equals(TableBuilder *b) {
+    for (size_t i = 0; i < b->equals_count; i++) {
+        const PendingEquals *p = &b->equals[i];
+        TableRule *rule = &b->rules[p->rule];
+    
+        for (size_t k = 0; k < p->text_len;) {
+            uint32_t cp;
+            int n = utf8_decode((const unsigned char *)p->text + k, p->text_len - k, 1, &cp);
+            size_t len = n > 0 ? (size_t)n : 1;
+            const TableRule *def = builder_char_rule(b, p->text + k, len);
+    
+            if (def == NULL || rule->cell_count + def->cell_count > MAX_RULE_CELLS) {
+                fprintf(stderr, "Warning: cannot resolve '=' for '%.*s'\n", (int)p->text_len, p->text);
+                rule->cell_count = 0;
+                break;
             }
-            return is_capital ? c : (char)tolower((unsigned char)c);
+            memcpy(rule->cells + rule->cell_count, def->cells, def->cell_count);
+            rule->cell_count = (uint8_t)(rule->cell_count + def->cell_count);
+            k += len;
         }
     }
-    return '?';
 }
 
-static result_t pattern_to_text(unsigned char pattern, char *output, size_t output_size) {
-    if (output == NULL || output_size < PATTERN_LENGTH + 1) {
-        return RESULT_ERROR_ARGS;
+// Lay the trie out as flat arrays: node i becomes state i, its children
+// become a sorted edge range and its rules a range ordered by preference
+static result_t builder_flatten(const TableBuilder *b, TranslationTable *t) {
+    size_t edge_count = b->node_count - 1;
+    size_t rule_count = 0;
+    
+    for (size_t r = 0; r < b->rule_count; r++) {
+        rule_count += b->rules[r].cell_count > 0;
     }
     
-    output[0] = (pattern & 0x01) ? 'o' : '.';
-    output[1] = (pattern & 0x08) ? 'o' : '.';
-    output[2] = (pattern & 0x02) ? 'o' : '.';
-    output[3] = (pattern & 0x10) ? 'o' : '.';
-    output[4] = (pattern & 0x04) ? 'o' : '.';
-    output[5] = (pattern & 0x20) ? 'o' : '.';
-    output[6] = '\0';
+    t->state_count = (uint32_t)b->node_count;
+    t->edge_count = (uint32_t)edge_count;
+    t->rule_count = (uint32_t)rule_count;
+    t->max_text_len = b->max_text_len;
+    t->capsletter = b->capsletter;
+    t->numsign = b->numsign;
+    t->memory_size = table_body_size(t->state_count, t->edge_count, t->rule_count);
+    t->memory = calloc(1, t->memory_size);
+    t->mapped = 0;
+    if (t->memory == NULL) {
+        return RESULT_ERROR_MEMORY;
+    }
+    
+    unsigned char *body = t->memory;
+    table_set_arrays(t, body);
+    uint32_t *root = (uint32_t *)body;
+    memcpy(body + 256 * sizeof(uint32_t), b->word_byte, 256);
+    TableState *states = (TableState *)t->states;
+    TableEdge *edges = (TableEdge *)t->edges;
+    TableRule *rules = (TableRule *)t->rules;
+    
+    size_t e = 0;
+    size_t r = 0;
+    for (size_t node = 0; node < b->node_count; node++) {
+        TableState *s = &states[node];
+    
+        s->first_edge = (uint32_t)e;
+        for (uint32_t c = b->nodes[node].child; c; c = b->nodes[c].sibling) {
+            edges[e].target = c;
+            edges[e].byte = b->nodes[c].byte;
+            if (node == 0) {
+                root[edges[e].byte] = c;
+            }
+            e++;
+        }
+        s->edge_count = (uint16_t)(e - s->first_edge);
+    
+        // Insertion sort by preference keeps definition order among equals
+        s->first_rule = (uint32_t)r;
+        for (uint32_t k = b->nodes[node].rules; k != TABLE_NO_RULE; k = b->rule_next[k]) {
+            if (b->rules[k].cell_count == 0) {
+                continue;
+            }
+            size_t at = r;
+            while (at > s->first_rule && rules[at - 1].opcode > b->rules[k].opcode) {
+                rules[at] = rules[at - 1];
+                at--;
+            }
+            rules[at] = b->rules[k];
+            r++;
+        }
+        s->rule_count = (uint16_t)(r - s->first_rule);
+    }
     
     return RESULT_SUCCESS;
 }
 
-static unsigned char text_to_pattern(const char *text) {
-    if (text == NULL || strlen(text) < PATTERN_LENGTH) {
-        return 0;
+static void builder_free(TableBuilder *b) {
+    for (size_t i = 0; i < b->equals_count; i++) {
+        free(b->equals[i].text);
     }
+    for (size_t i = 0; i < b->source_count; i++) {
+        free(b->sources[i]);
+    }
+    free(b->nodes);
+    free(b->rules);
+    free(b->rule_next);
+    free(b->equals);
+    free(b->sources);
+}
+
+// Write the compiled table next to its source. A temporary file is renamed
+// into place so that readers never see a partial cache; failures only cost
+// the speed-up, so they are not reported.
+static void write_table_cache(const TableBuilder *b, const TranslationTable *t, const char *cache_path) {
+    TableCacheHeader header;
+    size_t sources_size = 0;
     
-    unsigned char pattern = 0;
-    if (text[0] == 'o') pattern |= 0x01;
-    if (text[1] == 'o') pattern |= 0x08;
-    if (text[2] == 'o') pattern |= 0x02;
-    if (text[3] == 'o') pattern |= 0x10;
-    if (text[4] == 'o') pattern |= 0x04;
-    if (text[5] == 'o') pattern |= 0x20;
+    for (size_t i = 0; i < b->source_count; i++) {
+        sources_size += sizeof(TableCacheSource) + ALIGN_8(strlen(b->sources[i]));
+    }
     
-    return pattern;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_CACHE_MAGIC, sizeof(header.magic));
+    header.byte_order = 0x01020304;
+    header.source_count = (uint32_t)b->source_count;
+    header.sources_size = (uint32_t)sources_size;
+    header.state_count = t->state_count;
+    header.edge_count = t->edge_count;
+    header.rule_count = t->rule_count;
+    header.max_text_len = t->max_text_len;
+    header.capsletter = t->capsletter;
+    header.numsign = t->numsign;
+    
+    char *temp_path = malloc(strlen(cache_path) + 32);
+    if (temp_path == NULL) {
+        return;
+    }
+    sprintf(temp_path, "%s.%ld", cache_path, (long)getpid());
+    
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        free(temp_path);
+        return;
+    }
+    
+    static const char zeros[8];
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(zeros, 1, ALIGN_8(sizeof(header)) - sizeof(header), file) == ALIGN_8(sizeof(header)) - sizeof(header);
+    
+    for (size_t i = 0; ok && i < b->source_count; i++) {
+        struct stat st;
+        TableCacheSource source;
+        size_t len = strlen(b->sources[i]);
+    
+        if (stat(b->sources[i], &st) != 0) {
+            ok = 0;
+            break;
+        }
+        memset(&source, 0, sizeof(source));
+        source.mtime = (int64_t)st.st_mtime;
+        source.size = (int64_t)st.st_size;
+        source.path_len = (uint32_t)len;
+        ok = fwrite(&source, sizeof(source), 1, file) == 1 &&
+             fwrite(b->sources[i], 1, len, file) == len &&
+             fwrite(zeros, 1, ALIGN_8(len) - len, file) == ALIGN_8(len) - len;
+    }
+    
+    ok = ok && fwrite(t->memory, 1, t->memory_size, file) == t->memory_size;
+    if (fclose(file) != 0 || !ok || rename(temp_path, cache_path) != 0) {
+        remove(temp_path);
+    }
+    free(temp_path);
 }
 
-static result_t write_pattern(FILE *output, unsigned char pattern, int text_mode) {
-    if (output == NULL) {
-        return RESULT_ERROR_ARGS;
+// Map a cached table if it is intact and no source file has changed since
+static int map_table_cache(TranslationTable *t, const char *table_path, const char *cache_path) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
     }
     
-    if (text_mode) {
-        char text_repr[PATTERN_LENGTH + 1];
-        result_t result = pattern_to_text(pattern, text_repr, sizeof(text_repr));
-        if (result != RESULT_SUCCESS) {
-            return result;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= ALIGN_8(sizeof(TableCacheHeader))) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    
+    const unsigned char *base = map;
+    size_t size = (size_t)st.st_size;
+    const TableCacheHeader *header = map;
+    char *resolved = realpath(table_path, NULL);
+    int valid = resolved != NULL &&
+                memcmp(header->magic, TABLE_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+                header->byte_order == 0x01020304 && header->source_count > 0 &&
+                header->state_count > 0 && header->edge_count == header->state_count - 1 &&
+                ALIGN_8(sizeof(*header)) + header->sources_size +
+                table_body_size(header->state_count, header->edge_count, header->rule_count) == size;
+    
+    // Every source must be unchanged; the first is the table itself
+    size_t offset = ALIGN_8(sizeof(*header));
+    for (uint32_t i = 0; valid && i < header->source_count; i++) {
+        const TableCacheSource *source = (const TableCacheSource *)(base + offset);
+        char path[PATH_MAX];
+        struct stat source_st;
+    
+        valid = offset + sizeof(*source) <= size && source->path_len < sizeof(path) &&
+                offset + sizeof(*source) + ALIGN_8(source->path_len) <= size;
+        if (valid) {
+            memcpy(path, source + 1, source->path_len);
+            path[source->path_len] = '\0';
+            valid = (i > 0 || strcmp(path, resolved) == 0) && stat(path, &source_st) == 0 &&
+                    (int64_t)source_st.st_mtime == source->mtime && (int64_t)source_st.st_size == source->size;
+            offset += sizeof(*source) + ALIGN_8(source->path_len);
         }
-        if (fprintf(output, "%s", text_repr) < 0) {
-            return RESULT_ERROR_IO;
+    }
+    free(resolved);
+    valid = valid && offset == ALIGN_8(sizeof(*header)) + header->sources_size;
+    
+    if (valid) {
+        t->state_count = header->state_count;
+        t->edge_count = header->edge_count;
+        t->rule_count = header->rule_count;
+        t->max_text_len = header->max_text_len;
+        t->capsletter = header->capsletter;
+        t->numsign = header->numsign;
+        table_set_arrays(t, base + offset);
+    
+        // A damaged cache must not send the translator out of bounds
+        valid = t->max_text_len <= MAX_RULE_TEXT && t->capsletter.cell_count <= MAX_RULE_CELLS &&
+                t->numsign.cell_count <= MAX_RULE_CELLS;
+        for (size_t i = 0; valid && i < 256; i++) {
+            valid = t->root[i] < t->state_count;
         }
-    } else {
-        wint_t braille_char = BRAILLE_BASE + pattern;
-        if (fputwc(braille_char, output) == WEOF) {
-            return RESULT_ERROR_IO;
+        for (uint32_t i = 0; valid && i < t->state_count; i++) {
+            const TableState *s = &t->states[i];
+            valid = (uint64_t)s->first_edge + s->edge_count <= t->edge_count &&
+                    (uint64_t)s->first_rule + s->rule_count <= t->rule_count;
+        }
+        for (uint32_t i = 0; valid && i < t->edge_count; i++) {
+            valid = t->edges[i].target > 0 && t->edges[i].target < t->state_count;
+        }
+        for (uint32_t i = 0; valid && i < t->rule_count; i++) {
+            valid = t->rules[i].cell_count <= MAX_RULE_CELLS;
         }
     }
     
-    return RESULT_SUCCESS;
+    if (!valid) {
+        munmap(map, size);
+        return 0;
+    }
+    t->memory = map;
+    t->memory_size = size;
+    t->mapped = 1;
+    return 1;
 }
 
-static result_t encode_braille(FILE *input, FILE *output, int text_mode) {
-    if (input == NULL || output == NULL) {
-        return RESULT_ERROR_ARGS;
+// Load a table from its cache, or compile it and write the cache
+static result_t load_table(const char *path) {
+    char *cache_path = malloc(strlen(path) + sizeof(TABLE_CACHE_SUFFIX));
+    if (cache_path == NULL) {
+        return RESULT_ERROR_MEMORY;
     }
+    strcpy(cache_path, path);
+    strcat(cache_path, TABLE_CACHE_SUFFIX);
     
-    int c;
-    int number_mode = 0;
-    size_t line_length = 0;
+    if (map_table_cache(&table, path, cache_path)) {
+        free(cache_path);
+        return RESULT_SUCCESS;
+    }
+    
+    TableBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    for (int c = 0; c < 256; c++) {
+        builder.word_byte[c] = isalpha(c) || c >= 0x80;
+    }
+    
+    // The root node
+    result_t result = grow_array((void **)&builder.nodes, &builder.node_cap, 1, sizeof(BuildNode))
+                          ? RESULT_SUCCESS : RESULT_ERROR_MEMORY;
+    if (result == RESULT_SUCCESS) {
+        builder.node_count = 1;
+        memset(&builder.nodes[0], 0, sizeof(BuildNode));
+        builder.nodes[0].rules = TABLE_NO_RULE;
+        result = parse_table_file(&builder, path, 0);
+    }
+    if (result == RESULT_SUCCESS) {
+        builder_resolve_equals(&builder);
+        result = builder_flatten(&builder, &table);
+    }
+    if (result == RESULT_SUCCESS) {
+        write_table_cache(&builder, &table, cache_path);
+    }
+    
+    builder_free(&builder);
+    free(cache_path);
+    return result;
+}
+
+static void free_table(void) {
+    if (table.mapped) {
+        munmap(table.memory, table.memory_size);
+    } else {
+        free(table.memory);
+    }
+    memset(&table, 0, sizeof(table));
+}
+
+static uint32_t table_next(uint32_t state, uint8_t byte) {
+    const TableEdge *edges = table.edges + table.states[state].first_edge;
+    size_t lo = 0;
+    size_t hi = table.states[state].edge_count;
     
-    while ((c = fgetc(input)) != EOF) {
-        if (ferror(input)) {
-            fprintf(stderr, "Error reading input\n");
-            return RESULT_ERROR_IO;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (edges[mid].byte < byte) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        
-        if (c == '\n') {
-            if (fputc('\n', output) == EOF) {
-                return RESULT_ERROR_IO;
+    }
+    return lo < table.states[state].edge_count && edges[lo].byte == byte ? edges[lo].target : 0;
+}
+
+// Longest rule that matches at p[0] and whose word context holds. Capitals
+// may only begin a contraction; a capital inside one breaks the match.
+static const TableRule *table_match(const unsigned char *p, size_t avail, int after_word, size_t *match_len) {
+    const TableRule *best = NULL;
+    uint32_t state = table.root[(uint8_t)tolower(p[0])];
+    
+    for (size_t len = 1; state != 0; len++) {
+        const TableState *s = &table.states[state];
+        int before_word = len < avail && table.word_byte[p[len]];
+    
+        for (uint32_t k = 0; k < s->rule_count; k++) {
+            const TableRule *rule = &table.rules[s->first_rule + k];
+            int fits;
+            switch (rule->opcode) {
+                case TABLE_WORD: fits = !after_word && !before_word; break;
+                case TABLE_BEGWORD: fits = !after_word && before_word; break;
+                case TABLE_ENDWORD: fits = after_word && !before_word; break;
+                case TABLE_MIDWORD: fits = after_word && before_word; break;
+                case TABLE_PARTWORD: fits = after_word || before_word; break;
+                default: fits = 1; break;
+            }
+            if (fits) {
+                best = rule;
+                *match_len = len;
+                break;
             }
-            number_mode = 0;
-            line_length = 0;
-            continue;
         }
-        
-        // Prevent extremely long lines
-        if (line_length > MAX_LINE_LENGTH) {
-            fprintf(stderr, "Warning: line too long, truncating\n");
-            continue;
+    
+        if (len == avail || (p[len] < 0x80 && isupper(p[len]))) {
+            break;
         }
-        
-        unsigned char pattern = char_to_braille((char)c);
-        if (pattern == 0xFF) {
-            if (isprint(c)) {
-                fprintf(stderr, "Warning: skipping unsupported character '%c'\n", c);
+        state = table_next(state, (uint8_t)tolower(p[len]));
+    }
+    
+    return best;
+}
+
+static result_t write_table_rule(out_buffer_t *out, const TableRule *rule, cell_format_t format) {
+    result_t result = RESULT_SUCCESS;
+    for (int k = 0; k < rule->cell_count && result == RESULT_SUCCESS; k++) {
+        result = write_pattern(out, rule->cells[k], format);
+    }
+    return result;
+}
+
+// Translate text with the loaded table. Enough input is kept buffered
+// ahead of the current position for the longest rule and the character
+// after it, so matches never depend on where a read happened to end.
+static result_t encode_table(FILE *input, FILE *output, cell_format_t format) {
+    static out_buffer_t out;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t lookahead = table.max_text_len < 4 ? 4 : table.max_text_len + 1;
+    size_t carry = 0;
+    int at_eof = 0;
+    int number_mode = 0;
+    int after_word = 0;
+    result_t result = RESULT_SUCCESS;
+    
+    out.stream = output;
+    out.len = 0;
+    
+    while (!at_eof && result == RESULT_SUCCESS) {
+        size_t want = sizeof(buffer) - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        size_t i = 0;
+        at_eof = bytes_read < want;
+    
+        while (i < len && result == RESULT_SUCCESS && (at_eof || len - i > lookahead)) {
+            size_t match_len = 0;
+            const TableRule *rule = NULL;
+    
+            if (buffer[i] == '\n') {
+                result = write_line_end(&out, format);
+                number_mode = 0;
+                after_word = 0;
+                i++;
+                continue;
+            }
+    
+            rule = table_match(buffer + i, len - i, after_word, &match_len);
+            if (rule == NULL) {
+                uint32_t code_point;
+                int n = utf8_decode(buffer + i, len - i, 1, &code_point);
+                if (n > 0 && buffer[i] >= 0x80) {
+                    fprintf(stderr, "Warning: no table rule for character U+%04X\n", (unsigned)code_point);
+                } else if (isprint(buffer[i])) {
+                    fprintf(stderr, "Warning: no table rule for character '%c'\n", buffer[i]);
+                } else {
+                    fprintf(stderr, "Warning: no table rule for character (0x%02X)\n", buffer[i]);
+                }
+                after_word = table.word_byte[buffer[i]];
+                number_mode = 0;
+                i += n > 0 ? (size_t)n : 1;
+                continue;
+            }
+    
+            if (rule->opcode == TABLE_DIGIT) {
+                if (!number_mode && table.numsign.cell_count > 0) {
+                    result = write_table_rule(&out, &table.numsign, format);
+                }
+                number_mode = 1;
             } else {
-                fprintf(stderr, "Warning: skipping unsupported character (0x%02X)\n", (unsigned char)c);
+                number_mode = 0;
             }
-            continue;
-        }
-        
-        // Handle numbers
-        if (isdigit(c) && !number_mode) {
-            result_t result = write_pattern(output, BRAILLE_NUMBER, text_mode);
-            if (result != RESULT_SUCCESS) {
-                return result;
+    
+            if (result == RESULT_SUCCESS && table.capsletter.cell_count > 0 &&
+                (rule->opcode == TABLE_UPPERCASE || (buffer[i] < 0x80 && isupper(buffer[i])))) {
+                result = write_table_rule(&out, &table.capsletter, format);
             }
-            number_mode = 1;
-            line_length++;
-        } else if (!isdigit(c) && c != ' ') {
-            number_mode = 0;
-        }
-        
-        // Handle capital letters
-        if (isupper(c) && isalpha(c)) {
-            result_t result = write_pattern(output, BRAILLE_CAPITAL, text_mode);
-            if (result != RESULT_SUCCESS) {
-                return result;
+            if (result == RESULT_SUCCESS) {
+                result = write_table_rule(&out, rule, format);
             }
-            line_length++;
-        }
-        
-        // Write character pattern
-        result_t result = write_pattern(output, pattern, text_mode);
-        if (result != RESULT_SUCCESS) {
-            return result;
+    
+            after_word = table.word_byte[buffer[i + match_len - 1]];
+            i += match_len;
         }
-        line_length++;
+    
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
     }
     
-    if (fputc('\n', output) == EOF) {
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading input\n");
         return RESULT_ERROR_IO;
     }
     
-    return RESULT_SUCCESS;
+    return write_end(&out, format);
 }
 
 static result_t decode_braille(FILE *input, FILE *output, int text_mode) {
@@ -284,52 +2819,7 @@ static result_t decode_braille(FILE *input, FILE *output, int text_mode) {
             }
         }
     } else {
-        wint_t wc;
-        int number_mode = 0;
-        int capital_next = 0;
-        size_t line_length = 0;
-        
-        while ((wc = fgetwc(input)) != WEOF) {
-            if (ferror(input)) {
-                fprintf(stderr, "Error reading input\n");
-                return RESULT_ERROR_IO;
-            }
-            
-            if (wc == L'\n') {
-                if (fputc('\n', output) == EOF) {
-                    return RESULT_ERROR_IO;
-                }
-                number_mode = 0;
-                capital_next = 0;
-                line_length = 0;
-                continue;
-            }
-            
-            if (line_length > MAX_LINE_LENGTH) {
-                fprintf(stderr, "Warning: line too long, truncating\n");
-                continue;
-            }
-            
-            if (wc >= BRAILLE_BASE && wc <= BRAILLE_BASE + 0x3F) {
-                unsigned char pattern = (unsigned char)(wc - BRAILLE_BASE);
-                
-                if (pattern == BRAILLE_NUMBER) {
-                    number_mode = 1;
-                } else if (pattern == BRAILLE_CAPITAL) {
-                    capital_next = 1;
-                } else {
-                    char decoded = braille_to_char(pattern, number_mode, capital_next);
-                    if (fputc(decoded, output) == EOF) {
-                        return RESULT_ERROR_IO;
-                    }
-                    if (!isdigit(decoded) && decoded != ' ') {
-                        number_mode = 0;
-                    }
-                    capital_next = 0;
-                }
-                line_length++;
-            }
-        }
+        return decode_unicode(input, output);
     }
     
     if (fputc('\n', output) == EOF) {
@@ -345,32 +2835,75 @@ int main(int argc, char *argv[]) {
     }
     
     int decode_mode = 0;
-    int text_mode = 0;
+    cell_format_t format = FORMAT_UNICODE;
+    int binary_mode = 0;
+    int grade2_mode = 0;
+    long wrap_cells = DEFAULT_WRAP_CELLS;
     const char *filename = NULL;
+    const char *table_path = NULL;
     FILE *input = NULL;
     FILE *output = stdout;
     result_t result = RESULT_SUCCESS;
     
-    if (setlocale(LC_ALL, "") == NULL) {
-        fprintf(stderr, "Warning: could not set locale\n");
-    }
-    
     static struct option long_options[] = {
         {"decode", no_argument, 0, 'd'},
         {"text-braille", no_argument, 0, 't'},
+        {"binary", no_argument, 0, 'b'},
+        {"wrap", required_argument, 0, 'w'},
+        {"grade2", no_argument, 0, 'g'},
+        {"brf", no_argument, 0, OPT_BRF},
+        {"grid", no_argument, 0, OPT_GRID},
+        {"cell-width", required_argument, 0, OPT_CELL_WIDTH},
+        {"table", required_argument, 0, OPT_TABLE},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "dthv", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "dtbw:ghv", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 decode_mode = 1;
                 break;
             case 't':
-                text_mode = 1;
+            case OPT_BRF:
+            case OPT_GRID:
+                if (format != FORMAT_UNICODE) {
+                    fprintf(stderr, "Error: --text-braille, --brf and --grid are mutually exclusive\n");
+                    return RESULT_ERROR_ARGS;
+                }
+                format = opt == 't' ? FORMAT_TEXT : opt == OPT_BRF ? FORMAT_BRF : FORMAT_GRID;
+                break;
+            case OPT_CELL_WIDTH: {
+                char *endptr;
+                errno = 0;
+                long width = strtol(optarg, &endptr, 10);
+                if (errno != 0 || endptr == optarg || *endptr != '\0' || width < 2 || width > MAX_GRID_CELL_WIDTH) {
+                    fprintf(stderr, "Error: invalid cell width '%s' (must be 2-%d)\n", optarg, MAX_GRID_CELL_WIDTH);
+                    return RESULT_ERROR_ARGS;
+                }
+                grid.cell_width = (int)width;
+                break;
+            }
+            case 'b':
+                binary_mode = 1;
+                break;
+            case 'g':
+                grade2_mode = 1;
+                break;
+            case 'w': {
+                char *endptr;
+                errno = 0;
+                wrap_cells = strtol(optarg, &endptr, 10);
+                if (errno != 0 || endptr == optarg || *endptr != '\0' || wrap_cells < 0 || wrap_cells > MAX_WRAP_CELLS) {
+                    fprintf(stderr, "Error: invalid wrap value '%s' (must be 0-%d)\n", optarg, MAX_WRAP_CELLS);
+                    return RESULT_ERROR_ARGS;
+                }
+                break;
+            }
+            case OPT_TABLE:
+                table_path = optarg;
                 break;
             case 'h':
                 print_usage(argv[0]);
@@ -393,25 +2926,58 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (binary_mode && (format != FORMAT_UNICODE || grade2_mode)) {
+        fprintf(stderr, "Error: --binary cannot be combined with --text-braille, --brf, --grid or --grade2\n");
+        return RESULT_ERROR_ARGS;
+    }
+    
+    if (format == FORMAT_BRF && decode_mode) {
+        fprintf(stderr, "Error: --brf is an output format and cannot be decoded\n");
+        return RESULT_ERROR_ARGS;
+    }
+    
+    if (table_path != NULL && (decode_mode || binary_mode || grade2_mode)) {
+        fprintf(stderr, "Error: --table only encodes, and cannot be combined with --binary or --grade2\n");
+        return RESULT_ERROR_ARGS;
+    }
+    
+    if (table_path != NULL) {
+        result = load_table(table_path);
+        if (result != RESULT_SUCCESS) {
+            return (int)result;
+        }
+    }
+    
     // Open input file
     if (filename == NULL || strcmp(filename, "-") == 0) {
         input = stdin;
     } else {
-        input = fopen(filename, "r");
+        input = fopen(filename, binary_mode ? "rb" : "r");
         if (input == NULL) {
             fprintf(stderr, "Error opening '%s': %s\n", filename, strerror(errno));
             return RESULT_ERROR_FILE;
         }
     }
     
+    grid.wrap_cells = wrap_cells;
+    
     // Process file
-    if (decode_mode) {
-        result = decode_braille(input, output, text_mode);
+    if (binary_mode) {
+        result = decode_mode ? decode_binary(input, output) : encode_binary(input, output, wrap_cells);
+    } else if (table_path != NULL) {
+        result = encode_table(input, output, format);
+    } else if (format == FORMAT_GRID && decode_mode) {
+        result = decode_grid(input, output, grade2_mode);
+    } else if (grade2_mode) {
+        result = decode_mode ? decode_grade2(input, output, format == FORMAT_TEXT) : encode_grade2(input, output, format);
+    } else if (decode_mode) {
+        result = decode_braille(input, output, format == FORMAT_TEXT);
     } else {
-        result = encode_braille(input, output, text_mode);
+        result = encode_braille(input, output, format);
     }
     
     // Cleanup
+    free_table();
     if (input != NULL && input != stdin) {
         if (fclose(input) != 0) {
             fprintf(stderr, "Warning: error closing input file: %s\n", strerror(errno));
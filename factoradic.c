@@ -5,6 +5,7 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
 
 #define VERSION "1.0"
 #define PROGRAM_NAME "factoradic"
@@ -12,6 +13,8 @@
 
 static int decode_mode = 0;
 static int verbose_mode = 0;
+static int batch_mode = 0;
+static char separator = ':';
 
 static void usage(void) {
     printf("Usage: %s [OPTION]... [FILE]\n", PROGRAM_NAME);
@@ -19,9 +22,13 @@ static void usage(void) {
     printf("With no FILE, or when FILE is -, read standard input.\n\n");
     printf("The factoradic number system uses factorial bases (1!, 2!, 3!, ...).\n");
     printf("Each digit position n can have values 0 to n.\n");
-    printf("Example: 463 (decimal) = 34201 (factoradic)\n\n");
+    printf("Example: 463 (decimal) = 34101 (factoradic)\n");
+    printf("Numbers of any size are accepted. Past nine positions a digit can exceed 9,\n");
+    printf("so digits are written in decimal and joined by the separator (default ':').\n\n");
     printf("Mandatory arguments to long options are mandatory for short options too.\n");
+    printf("  -b, --batch           fast conversion of large files, one number per line\n");
     printf("  -d, --decode          decode factoradic numbers to decimal\n");
+    printf("  -s, --separator=CHAR  separate digits with CHAR past nine positions\n");
     printf("  -v, --verbose         show conversion steps\n");
     printf("      --help            display this help and exit\n");
     printf("      --version         output version information and exit\n\n");
@@ -33,16 +40,757 @@ static void version(void) {
     printf("Converts between decimal and factorial base representation\n");
 }
 
+// 0! through 20!; 21! no longer fits in 64 bits
+static const unsigned long long factorials[MAX_DIGITS + 1] = {
+    1ULL, 1ULL, 2ULL, 6ULL, 24ULL, 120ULL, 720ULL, 5040ULL, 40320ULL,
+    362880ULL, 3628800ULL, 39916800ULL, 479001600ULL, 6227020800ULL,
+    87178291200ULL, 1307674368000ULL, 20922789888000ULL,
+    355687428096000ULL, 6402373705728000ULL, 121645100408832000ULL,
+    2432902008176640000ULL
+};
+
 static unsigned long long factorial(int n) {
     if (n <= 1) return 1;
-    unsigned long long result = 1;
-    for (int i = 2; i <= n; i++) {
-        if (result > ULLONG_MAX / i) {
-            return 0; // Overflow
+    if (n > MAX_DIGITS) {
+        return 0; // Overflow
+    }
+    return factorials[n];
+}
+
+// Arbitrary-precision path. Numbers are little-endian arrays of 32-bit
+// limbs with no leading zero limbs; zero has no limbs. Multiplication uses
+// Karatsuba above a threshold and division uses a Newton reciprocal, so
+// that the divide-and-conquer conversions below stay subquadratic.
+#define KARATSUBA_THRESHOLD 32
+#define NEWTON_THRESHOLD 48
+#define SCHOOLBOOK_DECIMAL_LIMBS 32
+#define FACTORADIC_LEAF_POSITIONS 32
+#define MAX_DECIMAL_LEVELS 40
+
+typedef struct {
+    uint32_t* limb;
+    size_t len;
+} bignum;
+
+static uint32_t* limbs_alloc(size_t n) {
+    uint32_t* p = calloc(n ? n : 1, sizeof(uint32_t));
+    if (!p) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static size_t limbs_trim(const uint32_t* a, size_t n) {
+    while (n > 0 && a[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+static int limbs_cmp(const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    an = limbs_trim(a, an);
+    bn = limbs_trim(b, bn);
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    while (an-- > 0) {
+        if (a[an] != b[an]) {
+            return a[an] < b[an] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r = a + b for an >= bn; r has an limbs and may alias a. Returns the carry.
+static uint32_t limbs_add(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < an; i++) {
+        carry += (uint64_t)a[i] + (i < bn ? b[i] : 0);
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return (uint32_t)carry;
+}
+
+// r = a - b for a >= b and an >= bn; r has an limbs and may alias a
+static void limbs_sub(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < an; i++) {
+        uint64_t t = (uint64_t)a[i] - (i < bn ? b[i] : 0) - borrow;
+        r[i] = (uint32_t)t;
+        borrow = (t >> 32) & 1;
+    }
+}
+
+// r = a * b; r has an + bn limbs and must not overlap a or b
+static void limbs_mul(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    if (an < bn) {
+        const uint32_t* t = a; a = b; b = t;
+        size_t tn = an; an = bn; bn = tn;
+    }
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+    if (bn == 0) {
+        return;
+    }
+    
+    if (bn < KARATSUBA_THRESHOLD) {
+        for (size_t i = 0; i < bn; i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < an; j++) {
+                carry += (uint64_t)a[j] * b[i] + r[i + j];
+                r[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            r[i + an] = (uint32_t)carry;
+        }
+        return;
+    }
+    
+    if (an >= 2 * bn) {
+        // Unbalanced: multiply b by slices of a of its own size
+        uint32_t* t = limbs_alloc(2 * bn);
+        for (size_t i = 0; i < an; i += bn) {
+            size_t k = an - i < bn ? an - i : bn;
+            limbs_mul(t, a + i, k, b, bn);
+            uint32_t carry = limbs_add(r + i, r + i, k + bn, t, k + bn);
+            for (size_t j = i + k + bn; carry && j < an + bn; j++) {
+                carry = ++r[j] == 0;
+            }
+        }
+        free(t);
+        return;
+    }
+    
+    // Karatsuba: (a1 B + a0)(b1 B + b0) with B = 2^(32h)
+    size_t h = an / 2;
+    size_t a1n = an - h;
+    size_t b1n = bn - h;
+    size_t sbn = (b1n > h ? b1n : h) + 1;
+    uint32_t* sa = limbs_alloc(a1n + 1);
+    uint32_t* sb = limbs_alloc(sbn);
+    uint32_t* z1 = limbs_alloc(a1n + 1 + sbn);
+    
+    sa[a1n] = limbs_add(sa, a + h, a1n, a, h);
+    if (b1n >= h) {
+        sb[sbn - 1] = limbs_add(sb, b + h, b1n, b, h);
+    } else {
+        sb[sbn - 1] = limbs_add(sb, b, h, b + h, b1n);
+    }
+    limbs_mul(z1, sa, a1n + 1, sb, sbn);
+    limbs_mul(r, a, h, b, h);
+    limbs_mul(r + 2 * h, a + h, a1n, b + h, b1n);
+    limbs_sub(z1, z1, a1n + 1 + sbn, r, 2 * h);
+    limbs_sub(z1, z1, a1n + 1 + sbn, r + 2 * h, an + bn - 2 * h);
+    
+    size_t z1n = limbs_trim(z1, a1n + 1 + sbn);
+    uint32_t carry = limbs_add(r + h, r + h, an + bn - h, z1, z1n);
+    (void)carry;
+    
+    free(sa);
+    free(sb);
+    free(z1);
+}
+
+// Schoolbook long division (Knuth, algorithm D). q gets an - bn + 1 limbs
+// and r gets bn limbs; b must have no leading zero limb and an >= bn.
+static void limbs_divmod(uint32_t* q, uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    if (bn == 1) {
+        uint64_t rem = 0;
+        for (size_t i = an; i-- > 0;) {
+            uint64_t cur = (rem << 32) | a[i];
+            q[i] = (uint32_t)(cur / b[0]);
+            rem = cur % b[0];
+        }
+        r[0] = (uint32_t)rem;
+        return;
+    }
+    
+    // Normalise so that the top bit of the divisor is set
+    int s = __builtin_clz(b[bn - 1]);
+    uint32_t* vn = limbs_alloc(bn);
+    uint32_t* un = limbs_alloc(an + 1);
+    for (size_t i = bn - 1; i > 0; i--) {
+        vn[i] = (b[i] << s) | (s ? (uint32_t)((uint64_t)b[i - 1] >> (32 - s)) : 0);
+    }
+    vn[0] = b[0] << s;
+    un[an] = s ? (uint32_t)((uint64_t)a[an - 1] >> (32 - s)) : 0;
+    for (size_t i = an - 1; i > 0; i--) {
+        un[i] = (a[i] << s) | (s ? (uint32_t)((uint64_t)a[i - 1] >> (32 - s)) : 0);
+    }
+    un[0] = a[0] << s;
+    
+    for (size_t j = an - bn + 1; j-- > 0;) {
+        uint64_t top = ((uint64_t)un[j + bn] << 32) | un[j + bn - 1];
+        uint64_t qhat = top / vn[bn - 1];
+        uint64_t rhat = top % vn[bn - 1];
+        
+        while (qhat >> 32 || qhat * vn[bn - 2] > ((rhat << 32) | un[j + bn - 2])) {
+            qhat--;
+            rhat += vn[bn - 1];
+            if (rhat >> 32) {
+                break;
+            }
+        }
+        
+        // Multiply and subtract
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < bn; i++) {
+            uint64_t p = qhat * vn[i] + carry;
+            carry = p >> 32;
+            int64_t t = (int64_t)un[i + j] - borrow - (int64_t)(p & 0xFFFFFFFFu);
+            un[i + j] = (uint32_t)t;
+            borrow = t < 0;
+        }
+        int64_t t = (int64_t)un[j + bn] - borrow - (int64_t)carry;
+        un[j + bn] = (uint32_t)t;
+        
+        // Rarely qhat is still one too large: add the divisor back
+        if (t < 0) {
+            qhat--;
+            un[j + bn] += limbs_add(un + j, un + j, bn, vn, bn);
+        }
+        q[j] = (uint32_t)qhat;
+    }
+    
+    for (size_t i = 0; i < bn; i++) {
+        r[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+    }
+    free(vn);
+    free(un);
+}
+
+static bignum bignum_make(uint32_t* limb, size_t n) {
+    bignum x = { limb, limbs_trim(limb, n) };
+    return x;
+}
+
+static bignum bignum_mul(const bignum* a, const bignum* b) {
+    uint32_t* r = limbs_alloc(a->len + b->len);
+    limbs_mul(r, a->limb, a->len, b->limb, b->len);
+    return bignum_make(r, a->len + b->len);
+}
+
+static bignum bignum_add(const bignum* a, const bignum* b) {
+    if (a->len < b->len) {
+        const bignum* t = a; a = b; b = t;
+    }
+    uint32_t* r = limbs_alloc(a->len + 1);
+    r[a->len] = limbs_add(r, a->limb, a->len, b->limb, b->len);
+    return bignum_make(r, a->len + 1);
+}
+
+// Shift left or right by whole limbs
+static bignum bignum_shift(const bignum* a, size_t left, size_t right) {
+    size_t n = a->len > right ? a->len - right + left : 0;
+    uint32_t* r = limbs_alloc(n);
+    if (n > 0) {
+        memcpy(r + left, a->limb + right, (a->len - right) * sizeof(uint32_t));
+    }
+    return bignum_make(r, n);
+}
+
+// a * m + add, in place
+static void bignum_mul_small(bignum* a, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    for (size_t i = 0; i < a->len; i++) {
+        carry += (uint64_t)a->limb[i] * m;
+        a->limb[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) {
+        uint32_t* grown = realloc(a->limb, (a->len + 1) * sizeof(uint32_t));
+        if (!grown) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        a->limb = grown;
+        a->limb[a->len++] = (uint32_t)carry;
+    }
+}
+
+// a / d in place; returns the remainder
+static uint32_t bignum_div_small(bignum* a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a->len; i-- > 0;) {
+        uint64_t cur = (rem << 32) | a->limb[i];
+        a->limb[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    a->len = limbs_trim(a->limb, a->len);
+    return (uint32_t)rem;
+}
+
+// floor(2^(64n) / b) for b of exactly n limbs. Each level halves the
+// precision, solves the smaller problem and refines it with one Newton
+// step; the result is then corrected to the exact floor.
+static bignum bignum_reciprocal(const bignum* b) {
+    size_t n = b->len;
+    uint32_t* power = limbs_alloc(2 * n + 1);
+    power[2 * n] = 1;
+    bignum x;
+    
+    if (n <= NEWTON_THRESHOLD) {
+        uint32_t* q = limbs_alloc(n + 2);
+        uint32_t* r = limbs_alloc(n);
+        limbs_divmod(q, r, power, 2 * n + 1, b->limb, n);
+        free(power);
+        free(r);
+        return bignum_make(q, n + 2);
+    }
+    
+    // Guard limbs keep the error of the half-size reciprocal to a few units
+    size_t h = n / 2 + 2;
+    bignum bh = { b->limb + (n - h), h };
+    bignum xh = bignum_reciprocal(&bh);
+    bignum x0 = bignum_shift(&xh, n - h, 0);
+    free(xh.limb);
+    
+    bignum t = bignum_mul(b, &x0);
+    size_t en = t.len > 2 * n + 1 ? t.len : 2 * n + 1;
+    uint32_t* e = limbs_alloc(en);
+    int under = limbs_cmp(t.limb, t.len, power, 2 * n + 1) <= 0;
+    if (under) {
+        limbs_sub(e, power, 2 * n + 1, t.limb, t.len);
+    } else {
+        limbs_sub(e, t.limb, t.len, power, 2 * n + 1);
+    }
+    bignum err = bignum_make(e, en);
+    bignum step = bignum_mul(&x0, &err);
+    bignum delta = bignum_shift(&step, 0, 2 * n);
+    free(t.limb);
+    free(err.limb);
+    free(step.limb);
+    
+    if (under) {
+        x = bignum_add(&x0, &delta);
+    } else {
+        uint32_t* d = limbs_alloc(x0.len);
+        limbs_sub(d, x0.limb, x0.len, delta.limb, delta.len);
+        x = bignum_make(d, x0.len);
+    }
+    free(x0.limb);
+    free(delta.limb);
+    
+    // Exact correction: 0 <= 2^(64n) - b x < b
+    t = bignum_mul(b, &x);
+    size_t tn = t.len > 2 * n + 2 ? t.len : 2 * n + 2;
+    uint32_t* xl = limbs_alloc(x.len + 2);
+    memcpy(xl, x.limb, x.len * sizeof(uint32_t));
+    free(x.limb);
+    x.limb = xl;
+    uint32_t* tl = limbs_alloc(tn);
+    memcpy(tl, t.limb, t.len * sizeof(uint32_t));
+    free(t.limb);
+    
+    uint32_t one = 1;
+    while (limbs_cmp(tl, tn, power, 2 * n + 1) > 0) {
+        limbs_sub(x.limb, x.limb, x.len, &one, 1);
+        limbs_sub(tl, tl, tn, b->limb, n);
+    }
+    uint32_t* gap = limbs_alloc(2 * n + 1);
+    for (;;) {
+        limbs_sub(gap, power, 2 * n + 1, tl, 2 * n + 1);
+        if (limbs_cmp(gap, 2 * n + 1, b->limb, n) < 0) {
+            break;
+        }
+        x.limb[x.len] = limbs_add(x.limb, x.limb, x.len, &one, 1);
+        x.len = limbs_trim(x.limb, x.len + 1);
+        limbs_add(tl, tl, tn, b->limb, n);
+    }
+    x.len = limbs_trim(x.limb, x.len);
+    
+    free(gap);
+    free(tl);
+    free(power);
+    return x;
+}
+
+// q = a / b, r = a % b for b != 0; either output may be NULL. Large
+// divisors use Barrett reduction with a Newton reciprocal, one block of
+// the divisor's size at a time.
+static void bignum_divmod(const bignum* a, const bignum* b, bignum* q, bignum* r) {
+    size_t n = b->len;
+    
+    if (limbs_cmp(a->limb, a->len, b->limb, n) < 0) {
+        if (q) {
+            *q = bignum_make(limbs_alloc(0), 0);
+        }
+        if (r) {
+            uint32_t* copy = limbs_alloc(a->len);
+            memcpy(copy, a->limb, a->len * sizeof(uint32_t));
+            *r = bignum_make(copy, a->len);
+        }
+        return;
+    }
+    
+    if (n <= NEWTON_THRESHOLD || a->len - n <= NEWTON_THRESHOLD) {
+        uint32_t* ql = limbs_alloc(a->len - n + 1);
+        uint32_t* rl = limbs_alloc(n);
+        limbs_divmod(ql, rl, a->limb, a->len, b->limb, n);
+        if (q) {
+            *q = bignum_make(ql, a->len - n + 1);
+        } else {
+            free(ql);
+        }
+        if (r) {
+            *r = bignum_make(rl, n);
+        } else {
+            free(rl);
+        }
+        return;
+    }
+    
+    bignum mu = bignum_reciprocal(b);
+    size_t blocks = (a->len + n - 1) / n;
+    uint32_t* ql = limbs_alloc(blocks * n);
+    uint32_t* cur = limbs_alloc(2 * n);    // remainder * 2^(32n) + block
+    uint32_t* prod = limbs_alloc(2 * n + mu.len);
+    uint32_t* qb = limbs_alloc(2 * n);
+    size_t rem_len = 0;
+    
+    for (size_t k = blocks; k-- > 0;) {
+        size_t start = k * n;
+        size_t count = a->len - start < n ? a->len - start : n;
+        
+        // The remainder from the block above is already in the top half
+        memset(cur, 0, n * sizeof(uint32_t));
+        memcpy(cur, a->limb + start, count * sizeof(uint32_t));
+        
+        // Quotient estimate floor(cur * mu / 2^(64n)) is low by at most 2
+        limbs_mul(prod, cur, 2 * n, mu.limb, mu.len);
+        bignum est = { prod + 2 * n, limbs_trim(prod + 2 * n, mu.len) };
+        size_t qn = est.len;
+        memset(qb, 0, 2 * n * sizeof(uint32_t));
+        if (qn > 0) {
+            uint32_t* t = limbs_alloc(qn + n);
+            limbs_mul(t, est.limb, qn, b->limb, n);
+            limbs_sub(cur, cur, 2 * n, t, limbs_trim(t, qn + n));
+            memcpy(qb, est.limb, qn * sizeof(uint32_t));
+            free(t);
+        }
+        while (limbs_cmp(cur, 2 * n, b->limb, n) >= 0) {
+            uint32_t one = 1;
+            limbs_sub(cur, cur, 2 * n, b->limb, n);
+            limbs_add(qb, qb, 2 * n, &one, 1);
+        }
+        memcpy(ql + start, qb, n * sizeof(uint32_t));
+        
+        // Move the remainder up for the next block
+        memmove(cur + n, cur, n * sizeof(uint32_t));
+        rem_len = limbs_trim(cur + n, n);
+    }
+    
+    if (q) {
+        *q = bignum_make(ql, blocks * n);
+    } else {
+        free(ql);
+    }
+    if (r) {
+        uint32_t* rl = limbs_alloc(n);
+        memcpy(rl, cur + n, n * sizeof(uint32_t));
+        *r = bignum_make(rl, rem_len);
+    }
+    free(mu.limb);
+    free(cur);
+    free(prod);
+    free(qb);
+}
+
+// Powers 10^(9 * 2^k), shared by decimal parsing and printing
+static bignum decimal_powers[MAX_DECIMAL_LEVELS];
+static int decimal_power_count = 0;
+
+static const bignum* decimal_power(int k) {
+    while (decimal_power_count <= k) {
+        if (decimal_power_count == 0) {
+            uint32_t* p = limbs_alloc(1);
+            p[0] = 1000000000u;
+            decimal_powers[0] = bignum_make(p, 1);
+        } else {
+            const bignum* prev = &decimal_powers[decimal_power_count - 1];
+            decimal_powers[decimal_power_count] = bignum_mul(prev, prev);
+        }
+        decimal_power_count++;
+    }
+    return &decimal_powers[k];
+}
+
+// Parse len decimal digits. Long strings are split so that the low part
+// has 9 * 2^k digits, and the halves are joined with one multiplication.
+static bignum bignum_from_decimal(const char* s, size_t len) {
+    if (len <= 9 * SCHOOLBOOK_DECIMAL_LIMBS) {
+        bignum x = bignum_make(limbs_alloc(0), 0);
+        for (size_t i = 0; i < len;) {
+            size_t chunk = (len - i) % 9 ? (len - i) % 9 : 9;
+            uint32_t value = 0;
+            uint32_t scale = 1;
+            for (size_t k = 0; k < chunk; k++, i++) {
+                value = value * 10 + (uint32_t)(s[i] - '0');
+                scale *= 10;
+            }
+            bignum_mul_small(&x, scale, value);
+        }
+        return x;
+    }
+    
+    int k = 0;
+    while (9 * ((size_t)2 << k) < len) {
+        k++;
+    }
+    size_t low_len = 9 * ((size_t)1 << k);
+    bignum high = bignum_from_decimal(s, len - low_len);
+    bignum low = bignum_from_decimal(s + len - low_len, low_len);
+    bignum scaled = bignum_mul(&high, decimal_power(k));
+    bignum x = bignum_add(&scaled, &low);
+    free(high.limb);
+    free(low.limb);
+    free(scaled.limb);
+    return x;
+}
+
+// Write x in decimal, zero-padded to pad digits, and return the end. x must
+// be below 10^(9 * 2^(k + 1)); it is split by 10^(9 * 2^k) until small.
+static char* bignum_put_decimal(const bignum* x, int k, size_t pad, char* p) {
+    if (x->len <= SCHOOLBOOK_DECIMAL_LIMBS) {
+        bignum t = { limbs_alloc(x->len), x->len };
+        char digits[10 * SCHOOLBOOK_DECIMAL_LIMBS + 9];
+        size_t n = 0;
+        memcpy(t.limb, x->limb, x->len * sizeof(uint32_t));
+        while (t.len > 0) {
+            uint32_t group = bignum_div_small(&t, 1000000000u);
+            for (int d = 0; d < 9; d++, group /= 10) {
+                digits[n++] = (char)('0' + group % 10);
+            }
+        }
+        free(t.limb);
+        while (n > 0 && digits[n - 1] == '0') {
+            n--;
+        }
+        for (size_t i = n; i < pad; i++) {
+            *p++ = '0';
+        }
+        while (n > 0) {
+            *p++ = digits[--n];
+        }
+        return p;
+    }
+    
+    const bignum* power = decimal_power(k);
+    if (limbs_cmp(x->limb, x->len, power->limb, power->len) < 0) {
+        return bignum_put_decimal(x, k - 1, pad, p);
+    }
+    
+    size_t low_digits = 9 * ((size_t)1 << k);
+    bignum q, r;
+    bignum_divmod(x, power, &q, &r);
+    p = bignum_put_decimal(&q, k - 1, pad > low_digits ? pad - low_digits : 0, p);
+    p = bignum_put_decimal(&r, k - 1, low_digits, p);
+    free(q.limb);
+    free(r.limb);
+    return p;
+}
+
+// Decimal string for x, to be freed by the caller
+static char* bignum_to_decimal(const bignum* x) {
+    char* text = malloc(x->len * 10 + 2);
+    if (!text) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (x->len == 0) {
+        strcpy(text, "0");
+        return text;
+    }
+    
+    int k = 0;
+    while ((decimal_power(k)->len - 1) * 2 < x->len) {
+        k++;
+    }
+    *bignum_put_decimal(x, k, 0, text) = '\0';
+    return text;
+}
+
+// Product tree for positions lo..hi: node spans[i] holds the product of
+// lo + 1 .. hi + 1, with children 2i and 2i + 1 splitting the range in
+// half. Leaves cover at most FACTORADIC_LEAF_POSITIONS positions.
+typedef struct {
+    bignum* spans;
+    size_t count;
+} product_tree;
+
+static void build_spans(product_tree* tree, size_t node, size_t lo, size_t hi) {
+    if (hi - lo < FACTORADIC_LEAF_POSITIONS) {
+        bignum x = bignum_make(limbs_alloc(0), 0);
+        bignum_mul_small(&x, 1, 1);
+        for (size_t j = lo + 1; j <= hi + 1; j++) {
+            bignum_mul_small(&x, (uint32_t)j, 0);
+        }
+        tree->spans[node] = x;
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    build_spans(tree, 2 * node, lo, mid);
+    build_spans(tree, 2 * node + 1, mid + 1, hi);
+    if (node > 1) {
+        tree->spans[node] = bignum_mul(&tree->spans[2 * node], &tree->spans[2 * node + 1]);
+    }
+}
+
+// Positions 1..positions; the root product itself is never needed
+static product_tree build_product_tree(size_t positions) {
+    product_tree tree;
+    tree.count = 8 * (positions / FACTORADIC_LEAF_POSITIONS + 1);
+    tree.spans = calloc(tree.count, sizeof(bignum));
+    if (!tree.spans) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (positions - 1 < FACTORADIC_LEAF_POSITIONS) {
+        return tree;
+    }
+    size_t mid = 1 + (positions - 1) / 2;
+    build_spans(&tree, 2, 1, mid);
+    build_spans(&tree, 3, mid + 1, positions);
+    return tree;
+}
+
+static void free_product_tree(product_tree* tree) {
+    for (size_t i = 0; i < tree->count; i++) {
+        free(tree->spans[i].limb);
+    }
+    free(tree->spans);
+}
+
+// Digits lo..hi of x = sum of digit[k] * (lo + 1) * ... * k. The number is
+// split by the product of the lower half's bases: the remainder holds the
+// lower digits and the quotient the upper ones. Consumes x.
+static void split_factoradic(const product_tree* tree, bignum x, size_t node, size_t lo, size_t hi, uint32_t* digits) {
+    if (hi - lo < FACTORADIC_LEAF_POSITIONS) {
+        for (size_t k = lo; k <= hi; k++) {
+            digits[k] = bignum_div_small(&x, (uint32_t)(k + 1));
         }
-        result *= i;
+        free(x.limb);
+        return;
     }
-    return result;
+    size_t mid = lo + (hi - lo) / 2;
+    bignum q, r;
+    bignum_divmod(&x, &tree->spans[2 * node], &q, &r);
+    free(x.limb);
+    split_factoradic(tree, r, 2 * node, lo, mid, digits);
+    split_factoradic(tree, q, 2 * node + 1, mid + 1, hi, digits);
+}
+
+// The inverse: join the halves as low + span(low) * high
+static bignum join_factoradic(const product_tree* tree, size_t node, size_t lo, size_t hi, const uint32_t* digits) {
+    if (hi - lo < FACTORADIC_LEAF_POSITIONS) {
+        bignum x = bignum_make(limbs_alloc(0), 0);
+        bignum_mul_small(&x, 1, digits[hi]);
+        for (size_t k = hi; k-- > lo;) {
+            bignum_mul_small(&x, (uint32_t)(k + 1), digits[k]);
+        }
+        return x;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    bignum low = join_factoradic(tree, 2 * node, lo, mid, digits);
+    bignum high = join_factoradic(tree, 2 * node + 1, mid + 1, hi, digits);
+    bignum scaled = bignum_mul(&high, &tree->spans[2 * node]);
+    bignum x = bignum_add(&scaled, &low);
+    free(low.limb);
+    free(high.limb);
+    free(scaled.limb);
+    return x;
+}
+// Write digits for positions count..1 (digits[k] is position k). Up to nine
+// positions every digit is one character; beyond that digits can exceed 9,
+// so they are written as decimal values joined by the separator.
+static void write_factoradic(const uint32_t* digits, size_t count, FILE* output) {
+    for (size_t k = count; k >= 1; k--) {
+        if (count <= 9) {
+            fputc('0' + (int)digits[k], output);
+        } else if (k == count) {
+            fprintf(output, "%u", digits[k]);
+        } else {
+            fprintf(output, "%c%u", separator, digits[k]);
+        }
+    }
+}
+
+// Number of positions for x: the smallest m with (m + 1)! > x is found by
+// tracking a truncated running product of 2..m + 1 as mantissa * 2^shift.
+// Working from the bit length it can overshoot by a position or two; the
+// caller strips leading zero digits.
+static size_t factoradic_positions(const bignum* x) {
+    uint64_t mantissa = 1;
+    uint64_t shift = 0;
+    size_t m = 1;
+    while (shift <= 32 * (uint64_t)x->len) {
+        m++;
+        mantissa *= m;
+        while (mantissa >> 32) {
+            mantissa >>= 1;
+            shift++;
+        }
+    }
+    return m - 1;
+}
+
+static void big_decimal_to_factoradic(const char* text, size_t len, FILE* output) {
+    bignum x = bignum_from_decimal(text, len);
+    size_t count = factoradic_positions(&x);
+    uint32_t* digits = limbs_alloc(count + 1);
+    
+    if (verbose_mode) {
+        fprintf(output, "Converting %zu-digit number to factoradic (%zu limbs, up to %zu positions)\n",
+                len, x.len, count);
+    }
+    
+    product_tree tree = build_product_tree(count);
+    split_factoradic(&tree, x, 1, 1, count, digits);
+    free_product_tree(&tree);
+    
+    while (count > 1 && digits[count] == 0) {
+        count--;
+    }
+    
+    if (verbose_mode) {
+        fprintf(output, "Result: ");
+    }
+    
+    write_factoradic(digits, count, output);
+    
+    if (verbose_mode) {
+        fprintf(output, " (factoradic, %zu positions)", count);
+    }
+    
+    fprintf(output, "\n");
+    free(digits);
+}
+
+static void big_factoradic_to_decimal(const uint32_t* digits, size_t count, FILE* output) {
+    if (verbose_mode) {
+        fprintf(output, "Converting %zu-position factoradic number\n", count);
+    }
+    
+    product_tree tree = build_product_tree(count);
+    bignum x = join_factoradic(&tree, 1, 1, count, digits);
+    free_product_tree(&tree);
+    char* text = bignum_to_decimal(&x);
+    
+    if (verbose_mode) {
+        fprintf(output, "Result: ");
+    }
+    
+    fprintf(output, "%s", text);
+    
+    if (verbose_mode) {
+        fprintf(output, " (decimal, %zu digits)", strlen(text));
+    }
+    
+    fprintf(output, "\n");
+    free(text);
+    free(x.limb);
 }
 
 static void decimal_to_factoradic(unsigned long long num, FILE* output) {
@@ -61,8 +809,7 @@ static void decimal_to_factoradic(unsigned long long num, FILE* output) {
         max_pos++;
     }
     
-    char result[MAX_DIGITS + 1] = {0};
-    int result_pos = 0;
+    uint32_t digits[MAX_DIGITS + 1] = {0};
     unsigned long long remaining = num;
     
     if (verbose_mode) {
@@ -80,7 +827,7 @@ static void decimal_to_factoradic(unsigned long long num, FILE* output) {
             return;
         }
         
-        result[result_pos++] = '0' + digit;
+        digits[pos] = digit;
         
         if (verbose_mode) {
             fprintf(output, "%llu ÷ %d! (%llu) = %d remainder %llu\n", 
@@ -90,13 +837,11 @@ static void decimal_to_factoradic(unsigned long long num, FILE* output) {
         remaining %= fact;
     }
     
-    result[result_pos] = '\0';
-    
     if (verbose_mode) {
         fprintf(output, "Result: ");
     }
     
-    fprintf(output, "%s", result);
+    write_factoradic(digits, max_pos, output);
     
     if (verbose_mode) {
         fprintf(output, " (factoradic)");
@@ -105,51 +850,98 @@ static void decimal_to_factoradic(unsigned long long num, FILE* output) {
     fprintf(output, "\n");
 }
 
-static void factoradic_to_decimal(const char* factoradic, FILE* output) {
-    int len = strlen(factoradic);
-    unsigned long long result = 0;
+// Digits of a factoradic number into a new array, digits[k] for position k.
+// Digits are single characters unless the separator appears, in which case
+// each separated field is one decimal digit value.
+static uint32_t* parse_factoradic(const char* factoradic, size_t* count_out) {
+    int delimited = strchr(factoradic, separator) != NULL;
+    size_t count = delimited ? 1 : strlen(factoradic);
     
-    if (verbose_mode) {
-        fprintf(output, "Converting %s from factoradic:\n", factoradic);
+    if (delimited) {
+        for (const char* p = factoradic; *p; p++) {
+            count += *p == separator;
+        }
     }
     
-    // Process each digit from left to right
-    for (int i = 0; i < len; i++) {
-        char c = factoradic[i];
+    uint32_t* digits = limbs_alloc(count + 1);
+    const char* p = factoradic;
+    
+    for (size_t position = count; position >= 1; position--) {
+        uint64_t digit = 0;
         
-        if (!isdigit(c)) {
-            fprintf(stderr, "Error: Invalid character '%c' in factoradic number\n", c);
-            return;
+        if (!delimited) {
+            if (!isdigit((unsigned char)*p)) {
+                fprintf(stderr, "Error: Invalid character '%c' in factoradic number\n", *p);
+                free(digits);
+                return NULL;
+            }
+            digit = *p++ - '0';
+        } else {
+            const char* start = p;
+            while (isdigit((unsigned char)*p)) {
+                if (digit <= UINT32_MAX) {
+                    digit = digit * 10 + (*p - '0');
+                }
+                p++;
+            }
+            if (p == start || (*p != separator && *p != '\0')) {
+                fprintf(stderr, "Error: Invalid digit field at position %zu in factoradic number\n", position);
+                free(digits);
+                return NULL;
+            }
+            if (*p == separator) {
+                p++;
+            }
         }
         
-        int digit = c - '0';
-        int position = len - i;  // Position in factoradic (rightmost is position 1)
-        
         // Check if digit is valid for this position
         if (digit > position) {
-            fprintf(stderr, "Error: Digit %d at position %d exceeds maximum allowed (%d)\n", 
-                    digit, position, position);
-            return;
+            fprintf(stderr, "Error: Digit %llu at position %zu exceeds maximum allowed (%zu)\n", 
+                    (unsigned long long)digit, position, position);
+            free(digits);
+            return NULL;
         }
-        
+        digits[position] = (uint32_t)digit;
+    }
+    
+    *count_out = count;
+    return digits;
+}
+
+static void factoradic_to_decimal(const char* factoradic, FILE* output) {
+    size_t count;
+    uint32_t* digits = parse_factoradic(factoradic, &count);
+    if (!digits) {
+        return;
+    }
+    
+    // Numbers past 64 bits take the arbitrary-precision path
+    unsigned long long result = 0;
+    int fits = count <= MAX_DIGITS;
+    for (size_t position = count; fits && position >= 1; position--) {
         unsigned long long fact = factorial(position);
-        unsigned long long contribution = digit * fact;
-        
-        // Check for overflow
-        if (result > ULLONG_MAX - contribution) {
-            fprintf(stderr, "Error: Number too large for conversion\n");
-            return;
-        }
-        
-        result += contribution;
-        
-        if (verbose_mode) {
-            fprintf(output, "%d × %d! (%llu) = %llu\n", 
-                    digit, position, fact, contribution);
+        if (digits[position] > 0 && fact > ULLONG_MAX / digits[position]) {
+            fits = 0;
+        } else if (result > ULLONG_MAX - digits[position] * fact) {
+            fits = 0;
+        } else {
+            result += digits[position] * fact;
         }
     }
     
+    if (!fits) {
+        big_factoradic_to_decimal(digits, count, output);
+        free(digits);
+        return;
+    }
+    
     if (verbose_mode) {
+        fprintf(output, "Converting %s from factoradic:\n", factoradic);
+        for (size_t position = count; position >= 1; position--) {
+            unsigned long long fact = factorial(position);
+            fprintf(output, "%u × %zu! (%llu) = %llu\n", 
+                    digits[position], position, fact, digits[position] * fact);
+        }
         fprintf(output, "Result: ");
     }
     
@@ -160,51 +952,327 @@ static void factoradic_to_decimal(const char* factoradic, FILE* output) {
     }
     
     fprintf(output, "\n");
+    free(digits);
+}
+
+// Convert one line; line must be NUL-terminated
+static void process_line(const char* line, size_t line_len, char** clean, size_t* clean_size, FILE* output) {
+    size_t clean_pos = 0;
+    int found_decimal = 0;
+    
+    if (line_len + 1 > *clean_size) {
+        *clean_size = line_len + 1;
+        char* grown = realloc(*clean, *clean_size);
+        if (!grown) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        *clean = grown;
+    }
+    
+    // Extract only numeric characters (and separators when decoding)
+    // before decimal point
+    for (size_t i = 0; i < line_len; i++) {
+        if (line[i] == '.' || line[i] == ',') {
+            found_decimal = 1;
+            break;  // Stop at decimal point
+        }
+        if (isdigit((unsigned char)line[i]) || (decode_mode && line[i] == separator)) {
+            (*clean)[clean_pos++] = line[i];
+        }
+    }
+    (*clean)[clean_pos] = '\0';
+    
+    // Skip if no digits found
+    if (clean_pos == 0) {
+        fprintf(stderr, "Error: No valid digits found in input: %s", line);
+        return;
+    }
+    
+    if (decode_mode) {
+        factoradic_to_decimal(*clean, output);
+    } else {
+        // Anything past 64 bits takes the arbitrary-precision path
+        const char* number = *clean;
+        while (clean_pos > 1 && *number == '0') {
+            number++;
+            clean_pos--;
+        }
+        if (clean_pos < 20 || (clean_pos == 20 && strcmp(number, "18446744073709551615") <= 0)) {
+            decimal_to_factoradic(strtoull(number, NULL, 10), output);
+        } else {
+            big_decimal_to_factoradic(number, clean_pos, output);
+        }
+    }
+    
+    if (found_decimal && verbose_mode) {
+        fprintf(stderr, "Note: Truncated fractional part, using integer portion only\n");
+    }
 }
 
 static void process_input(FILE* input, FILE* output) {
-    char line[256];
-    char clean[256];
+    char* line = NULL;
+    size_t line_size = 0;
+    char* clean = NULL;
+    size_t clean_size = 0;
+    ssize_t line_len;
+    
+    while ((line_len = getline(&line, &line_size, input)) != -1) {
+        process_line(line, line_len, &clean, &clean_size, output);
+    }
+    
+    free(line);
+    free(clean);
+}
+
+// Batch mode: input is read in large blocks and each line is parsed by
+// hand; lines that fit in 64 bits are converted with the factorial table
+// and formatted straight into an output buffer. Anything else (big
+// numbers, separators, errors) goes through process_line, after the
+// buffered output so far has been written.
+#define BATCH_INPUT_SIZE (1 << 20)
+#define BATCH_OUTPUT_SIZE (1 << 16)
+#define BATCH_MAX_RECORD 64  // Longest formatted result, with newline
+
+typedef struct {
+    char data[BATCH_OUTPUT_SIZE];
+    size_t len;
+    FILE* output;
+} BatchOutput;
+
+static void batch_flush(BatchOutput* out) {
+    fwrite(out->data, 1, out->len, out->output);
+    out->len = 0;
+}
+
+// Digits of x for positions 1..20 by division by 2, 3, ..., 21. Two
+// independent chains split at 10! shorten the dependency chain, and each
+// divisor is a constant, so the compiler turns it into a multiply and shift.
+#define BATCH_DIGIT(x, k) digits[k] = (uint32_t)((x) % ((k) + 1)); (x) /= (k) + 1;
+
+static size_t batch_factoradic_digits(unsigned long long x, uint32_t* digits) {
+    uint32_t low = (uint32_t)(x % 3628800);
+    unsigned long long high = x / 3628800;
     
-    while (fgets(line, sizeof(line), input)) {
-        int clean_pos = 0;
-        int found_decimal = 0;
+    BATCH_DIGIT(low, 1) BATCH_DIGIT(low, 2) BATCH_DIGIT(low, 3)
+    BATCH_DIGIT(low, 4) BATCH_DIGIT(low, 5) BATCH_DIGIT(low, 6)
+    BATCH_DIGIT(low, 7) BATCH_DIGIT(low, 8) BATCH_DIGIT(low, 9)
+    
+    size_t count = 9;
+    if (high != 0) {
+        BATCH_DIGIT(high, 10) BATCH_DIGIT(high, 11) BATCH_DIGIT(high, 12)
+        BATCH_DIGIT(high, 13) BATCH_DIGIT(high, 14) BATCH_DIGIT(high, 15)
+        BATCH_DIGIT(high, 16) BATCH_DIGIT(high, 17) BATCH_DIGIT(high, 18)
+        BATCH_DIGIT(high, 19) BATCH_DIGIT(high, 20)
+        count = 20;
+    }
+    
+    while (count > 1 && digits[count] == 0) {
+        count--;
+    }
+    return count;
+}
+
+// The same layout as write_factoradic
+static char* batch_put_factoradic(const uint32_t* digits, size_t count, char* p) {
+    if (count <= 9) {
+        for (size_t k = count; k >= 1; k--) {
+            *p++ = (char)('0' + digits[k]);
+        }
+        return p;
+    }
+    for (size_t k = count; k >= 1; k--) {
+        if (digits[k] >= 10) {
+            *p++ = (char)('0' + digits[k] / 10);
+        }
+        *p++ = (char)('0' + digits[k] % 10);
+        *p++ = separator;
+    }
+    return p - 1;
+}
+
+static char* batch_put_decimal(unsigned long long x, char* p) {
+    char digits[MAX_DIGITS];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + x % 10);
+        x /= 10;
+    } while (x != 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// Convert line [p, end) into the output buffer. Returns 0 when the line
+// needs the general path.
+static int batch_line(const char* p, const char* end, BatchOutput* out) {
+    char* dst = out->data + out->len;
+    
+    if (decode_mode) {
+        // One pass reads the line both ways: as separated fields and as
+        // single-character digits, whichever it turns out to be. More than
+        // 20 positions, or fields longer than two characters, cannot be
+        // valid 64-bit digits; process_line sorts those out.
+        uint32_t digits[MAX_DIGITS + 1];
+        uint32_t fields[MAX_DIGITS + 1];
+        size_t count = 0;
+        size_t field_count = 0;
+        size_t field_len = 0;
+        uint32_t value = 0;
+        int delimited = 0;
+        for (; p < end && *p != '.' && *p != ','; p++) {
+            unsigned digit = (unsigned char)*p - '0';
+            if (digit <= 9) {
+                if (count <= MAX_DIGITS) {
+                    digits[count] = digit;
+                }
+                count++;
+                field_len++;
+                value = value * 10 + digit;
+            } else if (*p == separator) {
+                if (field_len == 0 || field_len > 2 || field_count == MAX_DIGITS) {
+                    return 0;
+                }
+                fields[field_count++] = value;
+                value = 0;
+                field_len = 0;
+                delimited = 1;
+            }
+        }
+        if (delimited) {
+            if (field_len == 0 || field_len > 2 || field_count == MAX_DIGITS) {
+                return 0;
+            }
+            fields[field_count++] = value;
+            memcpy(digits, fields, field_count * sizeof(uint32_t));
+            count = field_count;
+        } else if (count == 0 || count > MAX_DIGITS) {
+            return 0;
+        }
         
-        // Extract only numeric characters before decimal point
-        for (int i = 0; line[i] && clean_pos < sizeof(clean) - 1; i++) {
-            if (line[i] == '.' || line[i] == ',') {
-                found_decimal = 1;
-                break;  // Stop at decimal point
+        // Check if every digit is valid for its position; 20 positions
+        // can overflow, which leaves the number to the bignum path
+        unsigned long long result = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t position = count - i;
+            if (digits[i] > position) {
+                return 0;
             }
-            if (isdigit(line[i])) {
-                clean[clean_pos++] = line[i];
+            if (digits[i] > ULLONG_MAX / factorials[position]) {
+                return 0;
+            }
+            unsigned long long contribution = digits[i] * factorials[position];
+            if (result > ULLONG_MAX - contribution) {
+                return 0;
+            }
+            result += contribution;
+        }
+        dst = batch_put_decimal(result, dst);
+    } else {
+        unsigned long long x = 0;
+        int found_digit = 0;
+        for (; p < end && *p != '.' && *p != ','; p++) {
+            unsigned digit = (unsigned char)*p - '0';
+            if (digit <= 9) {
+                if (x > (ULLONG_MAX - digit) / 10) {
+                    return 0;  // Past 64 bits
+                }
+                found_digit = 1;
+                x = x * 10 + digit;
             }
         }
-        clean[clean_pos] = '\0';
+        if (!found_digit) {
+            return 0;
+        }
         
-        // Skip if no digits found
-        if (clean_pos == 0) {
-          fprintf(stderr, "Error: No valid digits found in input: %s", line);
-        continue;
+        uint32_t digits[MAX_DIGITS + 1];
+        size_t count = batch_factoradic_digits(x, digits);
+        dst = batch_put_factoradic(digits, count, dst);
+    }
+    
+    *dst++ = '\n';
+    out->len = dst - out->data;
+    return 1;
 }
 
-        
-        if (decode_mode) {
-            factoradic_to_decimal(clean, output);
-        } else {
-            unsigned long long num = strtoull(clean, NULL, 10);
-            decimal_to_factoradic(num, output);
+static void process_batch(FILE* input, FILE* output) {
+    size_t size = BATCH_INPUT_SIZE;
+    char* buffer = malloc(size);
+    BatchOutput* out = malloc(sizeof(BatchOutput));
+    char* clean = NULL;
+    size_t clean_size = 0;
+    size_t carry = 0;
+    int at_eof = 0;
+    
+    if (!buffer || !out) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    out->len = 0;
+    out->output = output;
+    
+    while (!at_eof) {
+        // A line longer than the whole buffer grows it
+        if (carry == size) {
+            size *= 2;
+            char* grown = realloc(buffer, size);
+            if (!grown) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            buffer = grown;
         }
         
-        if (found_decimal && verbose_mode) {
-            fprintf(stderr, "Note: Truncated fractional part, using integer portion only\n");
+        size_t want = size - carry;
+        size_t bytes_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + bytes_read;
+        at_eof = bytes_read < want;
+        
+        char* p = buffer;
+        char* limit = buffer + len;
+        while (p < limit) {
+            char* eol = memchr(p, '\n', limit - p);
+            if (!eol && !at_eof) {
+                break;
+            }
+            char* end = eol ? eol : limit;
+            
+            if (out->len > BATCH_OUTPUT_SIZE - BATCH_MAX_RECORD) {
+                batch_flush(out);
+            }
+            if (!batch_line(p, end, out)) {
+                // process_line wants the line as a string, newline included
+                size_t line_len = eol ? (size_t)(end - p) + 1 : (size_t)(end - p);
+                char* line = malloc(line_len + 1);
+                if (!line) {
+                    fprintf(stderr, "Error: out of memory\n");
+                    exit(EXIT_FAILURE);
+                }
+                memcpy(line, p, line_len);
+                line[line_len] = '\0';
+                batch_flush(out);
+                process_line(line, line_len, &clean, &clean_size, output);
+                free(line);
+            }
+            p = eol ? eol + 1 : limit;
         }
+        
+        carry = limit - p;
+        memmove(buffer, p, carry);
     }
+    
+    batch_flush(out);
+    free(out);
+    free(buffer);
+    free(clean);
 }
 
 int main(int argc, char *argv[]) {
     static struct option long_options[] = {
+        {"batch", no_argument, 0, 'b'},
         {"decode", no_argument, 0, 'd'},
+        {"separator", required_argument, 0, 's'},
         {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'V'},
@@ -212,11 +1280,22 @@ int main(int argc, char *argv[]) {
     };
     
     int c;
-    while ((c = getopt_long(argc, argv, "dvhV", long_options, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "bds:vhV", long_options, NULL)) != -1) {
         switch (c) {
+            case 'b':
+                batch_mode = 1;
+                break;
             case 'd':
                 decode_mode = 1;
                 break;
+            case 's':
+                if (strlen(optarg) != 1 || isdigit((unsigned char)optarg[0]) ||
+                    strchr(".,\n", optarg[0])) {
+                    fprintf(stderr, "Error: Separator must be a single character other than a digit, '.' or ','\n");
+                    exit(EXIT_FAILURE);
+                }
+                separator = optarg[0];
+                break;
             case 'v':
                 verbose_mode = 1;
                 break;
@@ -231,6 +1310,11 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (batch_mode && verbose_mode) {
+        fprintf(stderr, "Error: --batch cannot be combined with --verbose\n");
+        exit(EXIT_FAILURE);
+    }
+    
     FILE* input = stdin;
     
     if (optind < argc && strcmp(argv[optind], "-") != 0) {
@@ -241,7 +1325,11 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    process_input(input, stdout);
+    if (batch_mode) {
+        process_batch(input, stdout);
+    } else {
+        process_input(input, stdout);
+    }
     
     if (input != stdin) {
         fclose(input);
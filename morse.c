@@ -4,10 +4,46 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
 
 #define BUFFER_SIZE 8192
 #define MAX_MORSE_LENGTH 10
+#define MAX_FUZZY_LENGTH 16
 #define MAX_SEPARATOR_LENGTH 10
+#define OUTPUT_BUFFER_SIZE 65536
+#define MAX_ENCODED_CHAR (2 * (MAX_SEPARATOR_LENGTH + MAX_MORSE_LENGTH) + 1)
+#define MAX_ENCODE_ENTRIES 256
+#define MAX_TRIE_NODES 256
+
+// Audio defaults
+#define DEFAULT_WPM 20
+#define DEFAULT_TONE_HZ 600
+#define DEFAULT_SAMPLE_RATE 8000
+#define TONE_AMPLITUDE (0.8 * 32767.0)
+#define TONE_RAMP_SECONDS 0.005
+#define WAV_HEADER_SIZE 44
+#define DETECT_BLOCK_SECONDS 0.005
+#define PEAK_DECAY_SECONDS 2.0
+#define NOISE_RISE_SECONDS 5.0
+
+// Long-only options
+enum {
+    OPT_WAV = 256,
+    OPT_WPM,
+    OPT_FARNSWORTH,
+    OPT_TONE_HZ,
+    OPT_SAMPLE_RATE,
+    OPT_DECODE_WAV,
+    OPT_KEYED,
+    OPT_ALPHABET,
+    OPT_TIMING,
+    OPT_BITSTREAM,
+    OPT_FUZZY
+};
+
+#define MORSE_KEY(len, bits) ((1U << (len)) | (bits))
 
 // Exit codes
 #define EXIT_SUCCESS 0
@@ -15,284 +51,1990 @@
 #define EXIT_FILE_ERROR 2
 #define EXIT_INVALID_DATA 3
 
-// Morse code lookup table
+// Morse code lookup table: a UTF-8 character or prosign and its code. A space
+// in the code separates the symbols of a character sent as two letters.
+typedef struct {
+    const char *text;
+    const char *morse;
+} MorseEntry;
+
+// Standard International Morse Code letters, with common accented letters
+static const MorseEntry latin_letters[] = {
+    {"A", ".-"}, {"B", "-..."}, {"C", "-.-."}, {"D", "-.."}, {"E", "."}, {"F", "..-."}, 
+    {"G", "--."}, {"H", "...."}, {"I", ".."}, {"J", ".---"}, {"K", "-.-"}, {"L", ".-.."}, 
+    {"M", "--"}, {"N", "-."}, {"O", "---"}, {"P", ".--."}, {"Q", "--.-"}, {"R", ".-."}, 
+    {"S", "..."}, {"T", "-"}, {"U", "..-"}, {"V", "...-"}, {"W", ".--"}, {"X", "-..-"}, 
+    {"Y", "-.--"}, {"Z", "--.."}, 
+    {"À", ".--.-"}, {"Å", ".--.-"}, {"Ä", ".-.-"}, {"Æ", ".-.-"}, {"Ç", "-.-.."},
+    {"É", "..-.."}, {"È", ".-..-"}, {"Ñ", "--.--"}, {"Ö", "---."}, {"Ø", "---."},
+    {"Ü", "..--"},
+    {NULL, NULL}  // End marker
+};
+
+// Numbers and punctuation, shared by every alphabet
+static const MorseEntry common_symbols[] = {
+    {"0", "-----"}, {"1", ".----"}, {"2", "..---"}, {"3", "...--"}, {"4", "....-"}, 
+    {"5", "....."}, {"6", "-...."}, {"7", "--..."}, {"8", "---.."}, {"9", "----."},
+    {".", ".-.-.-"}, {",", "--..--"}, {"?", "..--.."}, {"'", ".----."}, {"!", "-.-.--"},
+    {"/", "-..-."}, {"(", "-.--."}, {")", "-.--.-"}, {"&", ".-..."}, {":", "---..."},
+    {";", "-.-.-."}, {"=", "-...-"}, {"+", ".-.-."}, {"-", "-....-"}, {"_", "..--.-"},
+    {"\"", ".-..-."}, {"$", "...-..-"}, {"@", ".--.-."},
+    {NULL, NULL}
+};
+
+// Prosigns, written in angle brackets; decoded only where no character has the code
+static const MorseEntry prosigns[] = {
+    {"<AR>", ".-.-."}, {"<AS>", ".-..."}, {"<BK>", "-...-.-"}, {"<BT>", "-...-"},
+    {"<CL>", "-.-..-.."}, {"<CT>", "-.-.-"}, {"<KA>", "-.-.-"}, {"<KN>", "-.--."},
+    {"<SK>", "...-.-"}, {"<SN>", "...-."}, {"<VE>", "...-."}, {"<SOS>", "...---..."},
+    {"<HH>", "........"},
+    {NULL, NULL}
+};
+
+// Russian Morse code
+static const MorseEntry cyrillic_letters[] = {
+    {"А", ".-"}, {"Б", "-..."}, {"В", ".--"}, {"Г", "--."}, {"Д", "-.."}, {"Е", "."},
+    {"Ё", "."}, {"Ж", "...-"}, {"З", "--.."}, {"И", ".."}, {"Й", ".---"}, {"К", "-.-"},
+    {"Л", ".-.."}, {"М", "--"}, {"Н", "-."}, {"О", "---"}, {"П", ".--."}, {"Р", ".-."},
+    {"С", "..."}, {"Т", "-"}, {"У", "..-"}, {"Ф", "..-."}, {"Х", "...."}, {"Ц", "-.-."},
+    {"Ч", "---."}, {"Ш", "----"}, {"Щ", "--.-"}, {"Ъ", "--.--"}, {"Ы", "-.--"}, {"Ь", "-..-"},
+    {"Э", "..-.."}, {"Ю", "..--"}, {"Я", ".-.-"},
+    {NULL, NULL}
+};
+
+// Greek Morse code
+static const MorseEntry greek_letters[] = {
+    {"Α", ".-"}, {"Β", "-..."}, {"Γ", "--."}, {"Δ", "-.."}, {"Ε", "."}, {"Ζ", "--.."},
+    {"Η", "...."}, {"Θ", "-.-."}, {"Ι", ".."}, {"Κ", "-.-"}, {"Λ", ".-.."}, {"Μ", "--"},
+    {"Ν", "-."}, {"Ξ", "-..-"}, {"Ο", "---"}, {"Π", ".--."}, {"Ρ", ".-."}, {"Σ", "..."},
+    {"ς", "..."}, {"Τ", "-"}, {"Υ", "-.--"}, {"Φ", "..-."}, {"Χ", "----"}, {"Ψ", "--.-"},
+    {"Ω", ".--"},
+    {NULL, NULL}
+};
+
+// Wabun code (Japanese katakana); voiced kana are sent as the plain kana
+// followed by the dakuten or handakuten sign
+static const MorseEntry wabun_letters[] = {
+    {"イ", ".-"}, {"ロ", ".-.-"}, {"ハ", "-..."}, {"ニ", "-.-."}, {"ホ", "-.."}, {"ヘ", "."},
+    {"ト", "..-.."}, {"チ", "..-."}, {"リ", "--."}, {"ヌ", "...."}, {"ル", "-.--."}, {"ヲ", ".---"},
+    {"ワ", "-.-"}, {"カ", ".-.."}, {"ヨ", "--"}, {"タ", "-."}, {"レ", "---"}, {"ソ", "---."},
+    {"ツ", ".--."}, {"ネ", "--.-"}, {"ナ", ".-."}, {"ラ", "..."}, {"ム", "-"}, {"ウ", "..-"},
+    {"ヰ", ".-..-"}, {"ノ", "..--"}, {"オ", ".-..."}, {"ク", "...-"}, {"ヤ", ".--"}, {"マ", "-..-"},
+    {"ケ", "-.--"}, {"フ", "--.."}, {"コ", "----"}, {"エ", "-.---"}, {"テ", ".-.--"}, {"ア", "--.--"},
+    {"サ", "-.-.-"}, {"キ", "-.-.."}, {"ユ", "-..--"}, {"メ", "-...-"}, {"ミ", "..-.-"}, {"シ", "--.-."},
+    {"ヱ", ".--.."}, {"ヒ", "--..-"}, {"モ", "-..-."}, {"セ", ".---."}, {"ス", "---.-"}, {"ン", ".-.-."},
+    {"゛", ".."}, {"゜", "..--."}, {"ー", ".--.-"}, {"、", ".-.-.-"},
+    {"ガ", ".-.. .."}, {"ギ", "-.-.. .."}, {"グ", "...- .."}, {"ゲ", "-.-- .."}, {"ゴ", "---- .."},
+    {"ザ", "-.-.- .."}, {"ジ", "--.-. .."}, {"ズ", "---.- .."}, {"ゼ", ".---. .."}, {"ゾ", "---. .."},
+    {"ダ", "-. .."}, {"ヂ", "..-. .."}, {"ヅ", ".--. .."}, {"デ", ".-.-- .."}, {"ド", "..-.. .."},
+    {"バ", "-... .."}, {"ビ", "--..- .."}, {"ブ", "--.. .."}, {"ベ", ". .."}, {"ボ", "-.. .."},
+    {"パ", "-... ..--."}, {"ピ", "--..- ..--."}, {"プ", "--.. ..--."}, {"ペ", ". ..--."}, {"ポ", "-.. ..--."},
+    {NULL, NULL}
+};
+
+typedef struct {
+    const char *name;
+    const MorseEntry *letters;
+} Alphabet;
+
+static const Alphabet alphabets[] = {
+    {"latin", latin_letters},
+    {"cyrillic", cyrillic_letters},
+    {"greek", greek_letters},
+    {"wabun", wabun_letters},
+    {NULL, NULL}
+};
+
+// Decode table indexed by MORSE_KEY: (1 << length) | element bits, where bit i
+// is set when element i is a dash. Built by load_alphabet; NULL = unknown.
+static const char *morse_decode_table[1U << (MAX_MORSE_LENGTH + 1)];
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTION]... [FILE]\n", program_name);
+    printf("Morse code encode or decode FILE, or standard input, to standard output.\n");
+    printf("With no FILE, or when FILE is -, read standard input.\n\n");
+    printf("  -d, --decode          decode morse code (convert morse to text)\n");
+    printf("  -s, --separator=SEP   character separator (default: space); --char-sep is an alias\n");
+    printf("  -w, --word-sep=SEP    word separator (default: ' / ')\n");
+    printf("      --wav=FILE        write keyed audio as a 16-bit mono WAV file instead of text\n");
+    printf("      --fuzzy[=N]       when decoding, read unknown sequences of up to N elements\n");
+    printf("                        (default: %d, max: %d) as the nearest code by edit distance\n",
+           MAX_MORSE_LENGTH, MAX_FUZZY_LENGTH);
+    printf("      --timing          write the keying signal as text, one character per unit:\n");
+    printf("                        '=' key down, '.' key up (e.g. '=.===' for A)\n");
+    printf("      --bitstream       write the keying signal as packed bits, one per unit,\n");
+    printf("                        most significant bit first, 1 = key down\n");
+    printf("      --wpm=N           character speed in words per minute (default: %d)\n", DEFAULT_WPM);
+    printf("      --farnsworth=N    stretch letter and word gaps to an overall speed of N wpm\n");
+    printf("      --tone-hz=N       tone frequency in Hz (default: %d)\n", DEFAULT_TONE_HZ);
+    printf("      --sample-rate=N   audio sample rate in Hz (default: %d)\n", DEFAULT_SAMPLE_RATE);
+    printf("      --decode-wav      decode keyed audio from a PCM WAV FILE; --tone-hz selects\n");
+    printf("                        the tone; the speed is measured from the signal and\n");
+    printf("                        --wpm only settles openings that fit two speeds (a lone\n");
+    printf("                        E or T); Farnsworth audio needs the --farnsworth speed\n");
+    printf("                        it was sent with\n");
+    printf("      --keyed[=FORMAT]  decode key timings: signed durations in ms, positive for\n");
+    printf("                        key down and negative for key up; FORMAT is 'text'\n");
+    printf("                        (default) or 'int32' for little-endian binary values\n");
+    printf("      --alphabet=NAME   letters to use: latin (default), cyrillic, greek or wabun\n");
+    printf("      --help           display this help and exit\n");
+    printf("      --version        output version information and exit\n\n");
+    printf("Encoding: Converts readable text to morse code using dots and dashes\n");
+    printf("Decoding: Converts morse code back to text (use spaces between letters, '/' between words,\n");
+    printf("          or exactly the separators given with -s and -w)\n");
+    printf("Supported: the letters of the chosen alphabet in UTF-8, 0-9, common punctuation\n");
+    printf("marks, and prosigns such as <SK> and <AR>. A prosign decodes as written only when\n");
+    printf("no character shares its code (<AR> decodes as '+').\n");
+}
+
+void print_version() {
+    printf("morse 1.0\n");
+    printf("Simple morse code encoder/decoder\n");
+}
+
+// Parse an integer option value within [min, max]
+int parse_int_option(const char *str, const char *name, long min, long max, int *value) {
+    char *endptr;
+    errno = 0;
+    long val = strtol(str, &endptr, 10);
+    
+    if (errno != 0 || endptr == str || *endptr != '\0' || val < min || val > max) {
+        fprintf(stderr, "Error: invalid %s '%s' (must be %ld-%ld)\n", name, str, min, max);
+        return 0;
+    }
+    
+    *value = (int)val;
+    return 1;
+}
+
+// Validate separator string
+int validate_separator(const char *sep, const char *name) {
+    if (!sep) {
+        fprintf(stderr, "Error: %s cannot be null\n", name);
+        return 0;
+    }
+    if (strlen(sep) > MAX_SEPARATOR_LENGTH) {
+        fprintf(stderr, "Error: %s too long (max %d chars)\n", name, MAX_SEPARATOR_LENGTH);
+        return 0;
+    }
+    return 1;
+}
+
+// Encode entry: the code with the active character separator in front
+typedef struct {
+    const char *morse;          // from the alphabet table
+    char joined[MAX_ENCODED_CHAR];
+    unsigned char joined_len;
+    unsigned char sep_len;      // skip this many bytes for the first letter of a word
+} EncodeEntry;
+
+// Encode trie over the UTF-8 bytes of every character and prosign. A child
+// is 0 (no match), TRIE_LEAF | entry index for a key with no longer
+// continuation, or the index of the next node.
+#define TRIE_LEAF 0x8000U
+
+typedef struct {
+    uint16_t child[256];
+    int16_t entry;              // key ending at this node, -1 if none
+} TrieNode;
+
+static EncodeEntry encode_entries[MAX_ENCODE_ENTRIES];
+static int encode_entry_count;
+static TrieNode encode_trie[MAX_TRIE_NODES];
+static int trie_node_count;
+
+// Results of match_symbol besides an entry index
+#define MATCH_UNSUPPORTED (-1)
+#define MATCH_NEED_MORE (-2)
+
+static int new_trie_node(int entry) {
+    if (trie_node_count == MAX_TRIE_NODES) {
+        return 0;
+    }
+    TrieNode *node = &encode_trie[trie_node_count];
+    memset(node->child, 0, sizeof(node->child));
+    node->entry = (int16_t)entry;
+    return trie_node_count++;
+}
+
+// Add a key for an entry; the first entry added for a key wins
+static int trie_insert(const unsigned char *key, size_t len, int entry) {
+    int node = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        unsigned int v = encode_trie[node].child[key[i]];
+        
+        if (i + 1 == len) {
+            if (v == 0) {
+                encode_trie[node].child[key[i]] = (uint16_t)(TRIE_LEAF | (unsigned int)entry);
+            } else if (!(v & TRIE_LEAF) && encode_trie[v].entry < 0) {
+                encode_trie[v].entry = (int16_t)entry;
+            }
+            return 1;
+        }
+        
+        if (v == 0 || (v & TRIE_LEAF)) {
+            // Extend the trie, keeping a shorter key that ended here
+            int next = new_trie_node(v ? (int)(v & ~TRIE_LEAF) : -1);
+            if (next == 0) {
+                return 0;
+            }
+            encode_trie[node].child[key[i]] = (uint16_t)next;
+            v = (unsigned int)next;
+        }
+        node = (int)v;
+    }
+    return 1;
+}
+
+// Decode one UTF-8 sequence. Returns its length, 0 if more bytes are needed,
+// or -1 if the bytes are not valid UTF-8.
+static int utf8_decode(const unsigned char *p, size_t left, long *cp) {
+    int len = p[0] < 0x80 ? 1 : p[0] < 0xC2 ? -1 : p[0] < 0xE0 ? 2 : p[0] < 0xF0 ? 3 : p[0] < 0xF5 ? 4 : -1;
+    
+    if (len <= 1) {
+        *cp = p[0];
+        return len;
+    }
+    if (left < (size_t)len) {
+        for (size_t i = 1; i < left; i++) {
+            if ((p[i] & 0xC0) != 0x80) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    
+    long value = p[0] & (0x7F >> len);
+    for (int i = 1; i < len; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return -1;
+        }
+        value = (value << 6) | (p[i] & 0x3F);
+    }
+    *cp = value;
+    return len;
+}
+
+static size_t utf8_encode(long cp, unsigned char *out) {
+    if (cp < 0x80) {
+        out[0] = (unsigned char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (unsigned char)(0xC0 | (cp >> 6));
+        out[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    out[0] = (unsigned char)(0xE0 | (cp >> 12));
+    out[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+// Other spelling that encodes the same: lower case letters and hiragana
+static long alternate_form(long cp) {
+    if ((cp >= 'A' && cp <= 'Z') ||
+        (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) ||     // Latin-1 capitals
+        (cp >= 0x391 && cp <= 0x3A9) ||                 // Greek capitals
+        (cp >= 0x410 && cp <= 0x42F)) {                 // Cyrillic capitals
+        return cp + 0x20;
+    }
+    if (cp >= 0x400 && cp <= 0x40F) {
+        return cp + 0x50;
+    }
+    if (cp >= 0x30A1 && cp <= 0x30F6) {                 // Katakana to hiragana
+        return cp - 0x60;
+    }
+    return 0;
+}
+
+// Record one table entry for encoding (and optionally decoding)
+static int add_alphabet_entry(const MorseEntry *e, int decodable) {
+    const unsigned char *text = (const unsigned char *)e->text;
+    size_t text_len = strlen(e->text);
+    size_t code_len = strlen(e->morse);
+    
+    if (decodable && !strchr(e->morse, ' ')) {
+        unsigned int bits = 0;
+        for (size_t i = 0; i < code_len; i++) {
+            bits |= (unsigned int)(e->morse[i] == '-') << i;
+        }
+        if (!morse_decode_table[MORSE_KEY(code_len, bits)]) {
+            morse_decode_table[MORSE_KEY(code_len, bits)] = e->text;
+        }
+    }
+    
+    if (encode_entry_count == MAX_ENCODE_ENTRIES) {
+        return 0;
+    }
+    int entry = encode_entry_count++;
+    encode_entries[entry].morse = e->morse;
+    if (!trie_insert(text, text_len, entry)) {
+        return 0;
+    }
+    
+    // Lower case (or hiragana) spelling of a single character
+    long cp;
+    int len = utf8_decode(text, text_len, &cp);
+    if (len > 0 && (size_t)len == text_len && alternate_form(cp)) {
+        unsigned char alt[4];
+        return trie_insert(alt, utf8_encode(alternate_form(cp), alt), entry);
+    }
+    
+    // Lower case prosign
+    if (text[0] == '<') {
+        unsigned char lower[16];
+        for (size_t i = 0; i < text_len; i++) {
+            lower[i] = (unsigned char)tolower(text[i]);
+        }
+        return trie_insert(lower, text_len, entry);
+    }
+    return 1;
+}
+
+static int add_alphabet_table(const MorseEntry *table, int decodable) {
+    for (int i = 0; table[i].text; i++) {
+        if (!add_alphabet_entry(&table[i], decodable)) {
+            fprintf(stderr, "Error: alphabet tables too large\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Build the decode table and encode trie for an alphabet. Letters take
+// priority over numbers and punctuation, which take priority over prosigns;
+// Latin letters remain encodable in the other alphabets.
+static int load_alphabet(const Alphabet *alphabet) {
+    memset(morse_decode_table, 0, sizeof(morse_decode_table));
+    encode_entry_count = 0;
+    trie_node_count = 0;
+    new_trie_node(-1);  // Root
+    
+    return add_alphabet_table(alphabet->letters, 1) &&
+           add_alphabet_table(common_symbols, 1) &&
+           add_alphabet_table(prosigns, 1) &&
+           (alphabet->letters == latin_letters || add_alphabet_table(latin_letters, 0));
+}
+
+static const Alphabet *find_alphabet(const char *name) {
+    for (int i = 0; alphabets[i].name; i++) {
+        if (strcmp(alphabets[i].name, name) == 0) {
+            return &alphabets[i];
+        }
+    }
+    return NULL;
+}
+
+// Prefix every code with the character separator; the symbols of a
+// composite code are joined with it as well
+static void build_encode_table(const char *char_sep) {
+    size_t sep_len = strlen(char_sep);
+    
+    for (int i = 0; i < encode_entry_count; i++) {
+        EncodeEntry *entry = &encode_entries[i];
+        size_t len = sep_len;
+        
+        memcpy(entry->joined, char_sep, sep_len);
+        for (const char *m = entry->morse; *m; m++) {
+            if (*m == ' ') {
+                memcpy(entry->joined + len, char_sep, sep_len);
+                len += sep_len;
+            } else {
+                entry->joined[len++] = *m;
+            }
+        }
+        entry->joined[len] = '\0';
+        entry->joined_len = (unsigned char)len;
+        entry->sep_len = (unsigned char)sep_len;
+    }
+}
+
+// Find the longest character or prosign at p. Returns its entry index and
+// sets *consumed, or MATCH_UNSUPPORTED with *consumed covering one UTF-8
+// character, or MATCH_NEED_MORE if the buffer ends too soon to tell.
+static int match_symbol(const unsigned char *p, size_t left, int at_eof, size_t *consumed) {
+    int best = MATCH_UNSUPPORTED;
+    size_t best_len = 0;
+    unsigned int v = encode_trie[0].child[p[0]];
+    size_t i = 1;
+    
+    while (v != 0) {
+        if (v & TRIE_LEAF) {
+            *consumed = i;
+            return (int)(v & ~TRIE_LEAF);
+        }
+        if (encode_trie[v].entry >= 0) {
+            best = encode_trie[v].entry;
+            best_len = i;
+        }
+        if (i == left) {
+            if (!at_eof) {
+                return MATCH_NEED_MORE;
+            }
+            break;
+        }
+        v = encode_trie[v].child[p[i++]];
+    }
+    
+    if (best >= 0) {
+        *consumed = best_len;
+        return best;
+    }
+    
+    long cp;
+    int len = utf8_decode(p, left, &cp);
+    if (len == 0 && !at_eof) {
+        return MATCH_NEED_MORE;
+    }
+    *consumed = len > 0 ? (size_t)len : 1;
+    return MATCH_UNSUPPORTED;
+}
+
+// Warn about a skipped character, up to ten times
+static void warn_unsupported(const unsigned char *p, size_t len, int *unsupported_count) {
+    (*unsupported_count)++;
+    if (*unsupported_count > 10) {
+        return;
+    }
+    
+    long cp;
+    if (len > 1 && utf8_decode(p, len, &cp) == (int)len) {
+        fprintf(stderr, "Warning: skipping unsupported character '%.*s' (U+%04lX)\n", (int)len, (const char *)p, cp);
+    } else {
+        fprintf(stderr, "Warning: skipping unsupported character '%c' (0x%02X)\n", 
+                isprint(p[0]) ? p[0] : '?', p[0]);
+    }
+}
+
+// Find the text for a symbol of len elements, dashes set in bits (NULL if unknown)
+const char *morse_to_text(int len, unsigned int bits) {
+    if (len < 1 || len > MAX_MORSE_LENGTH) {
+        return NULL;
+    }
+    
+    return morse_decode_table[MORSE_KEY(len, bits)];
+}
+
+// Safe output functions
+int safe_fputc(int c, FILE *stream) {
+    if (fputc(c, stream) == EOF) {
+        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+int flush_output(char *data, size_t *len, FILE *stream) {
+    if (*len > 0 && fwrite(data, 1, *len, stream) != *len) {
+        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+        return 0;
+    }
+    *len = 0;
+    return 1;
+}
+
+// Encode text to morse code with buffering
+int encode_morse(FILE *input, FILE *output, const char *char_sep, const char *word_sep) {
+    unsigned char buffer[BUFFER_SIZE];
+    static char out[OUTPUT_BUFFER_SIZE];
+    size_t out_len = 0;
+    size_t word_sep_len = strlen(word_sep);
+    size_t carry = 0;
+    int first_char = 1;
+    int word_started = 0;
+    int unsupported_count = 0;
+    
+    build_encode_table(char_sep);
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t chars_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + chars_read;
+        int at_eof = chars_read < want;
+        size_t i = 0;
+        
+        while (i < len) {
+            unsigned char c = buffer[i];
+            
+            // Every case below appends at most MAX_ENCODED_CHAR bytes
+            if (out_len > sizeof(out) - MAX_ENCODED_CHAR && !flush_output(out, &out_len, output)) {
+                return EXIT_FILE_ERROR;
+            }
+            
+            if (c == ' ') {
+                // Space becomes word separator
+                if (word_started) {
+                    memcpy(out + out_len, word_sep, word_sep_len);
+                    out_len += word_sep_len;
+                    word_started = 0;
+                }
+                first_char = 1;
+                i++;
+                continue;
+            }
+            if (c == '\n') {
+                out[out_len++] = '\n';
+                first_char = 1;
+                word_started = 0;
+                i++;
+                continue;
+            }
+            
+            size_t consumed;
+            int match = match_symbol(buffer + i, len - i, at_eof, &consumed);
+            if (match == MATCH_NEED_MORE) {
+                break;  // Character or prosign continues in the next read
+            }
+            if (match == MATCH_UNSUPPORTED) {
+                // Unsupported character - skip with warning to stderr
+                warn_unsupported(buffer + i, consumed, &unsupported_count);
+            } else {
+                // Regular character, separator included unless it starts a word
+                const EncodeEntry *entry = &encode_entries[match];
+                size_t skip = first_char ? entry->sep_len : 0;
+                memcpy(out + out_len, entry->joined + skip, entry->joined_len - skip);
+                out_len += entry->joined_len - skip;
+                first_char = 0;
+                word_started = 1;
+            }
+            i += consumed;
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    // Check for read error
+    if (ferror(input)) {
+        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+        return EXIT_FILE_ERROR;
+    }
+    
+    if (unsupported_count > 10) {
+        fprintf(stderr, "Warning: %d total unsupported characters skipped\n", unsupported_count);
+    }
+    
+    out[out_len++] = '\n';
+    if (!flush_output(out, &out_len, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+typedef struct {
+    int wpm;
+    int farnsworth_wpm;     // 0 keeps standard spacing
+    int tone_hz;
+    int sample_rate;
+} AudioSettings;
+
+// Pre-rendered PCM blocks (16-bit little-endian) that make up the keyed signal
+typedef struct {
+    unsigned char *dit;
+    unsigned char *dah;
+    unsigned char *silence;     // long enough for the largest gap
+    size_t dit_bytes;
+    size_t dah_bytes;
+    size_t element_gap_bytes;
+    size_t char_gap_bytes;
+    size_t word_gap_bytes;
+} ToneTemplates;
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    put_le16(p, (uint16_t)(v & 0xFFFF));
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+// Render a tone of the given length with raised-cosine edges to avoid clicks
+static unsigned char *render_tone(size_t samples, const AudioSettings *settings) {
+    unsigned char *pcm = malloc(samples * 2);
+    if (!pcm) {
+        return NULL;
+    }
+    
+    size_t ramp = (size_t)(TONE_RAMP_SECONDS * settings->sample_rate);
+    if (ramp > samples / 4) {
+        ramp = samples / 4;
+    }
+    
+    const double step = 2.0 * M_PI * settings->tone_hz / settings->sample_rate;
+    for (size_t n = 0; n < samples; n++) {
+        double gain = 1.0;
+        if (n < ramp) {
+            gain = 0.5 - 0.5 * cos(M_PI * (double)n / (double)ramp);
+        } else if (n >= samples - ramp) {
+            gain = 0.5 - 0.5 * cos(M_PI * (double)(samples - 1 - n) / (double)ramp);
+        }
+        
+        long sample = lround(TONE_AMPLITUDE * gain * sin(step * (double)n));
+        put_le16(pcm + n * 2, (uint16_t)(int16_t)sample);
+    }
+    
+    return pcm;
+}
+
+// Length in seconds of one unit of letter and word spacing. PARIS timing
+// makes a unit 1.2 / wpm seconds; Farnsworth timing keeps the character
+// speed and stretches only the gaps (ARRL formula).
+static double gap_unit_at(double wpm, int farnsworth_wpm) {
+    if (farnsworth_wpm > 0 && farnsworth_wpm < wpm) {
+        double s = farnsworth_wpm;
+        return (60.0 * wpm - 37.2 * s) / (s * wpm) / 19.0;
+    }
+    return 1.2 / wpm;
+}
+
+static double gap_unit_seconds(const AudioSettings *settings) {
+    return gap_unit_at(settings->wpm, settings->farnsworth_wpm);
+}
+
+static int build_tone_templates(ToneTemplates *t, const AudioSettings *settings) {
+    double unit = 1.2 / settings->wpm;
+    double char_gap = 3.0 * gap_unit_seconds(settings);
+    double word_gap = 7.0 * gap_unit_seconds(settings);
+    
+    size_t unit_samples = (size_t)lround(unit * settings->sample_rate);
+    if (unit_samples == 0) {
+        unit_samples = 1;
+    }
+    
+    memset(t, 0, sizeof(*t));
+    t->dit_bytes = unit_samples * 2;
+    t->dah_bytes = unit_samples * 3 * 2;
+    t->element_gap_bytes = unit_samples * 2;
+    t->char_gap_bytes = (size_t)lround(char_gap * settings->sample_rate) * 2;
+    t->word_gap_bytes = (size_t)lround(word_gap * settings->sample_rate) * 2;
+    
+    t->dit = render_tone(unit_samples, settings);
+    t->dah = render_tone(unit_samples * 3, settings);
+    t->silence = calloc(1, t->word_gap_bytes > t->char_gap_bytes ? t->word_gap_bytes : t->char_gap_bytes);
+    
+    if (!t->dit || !t->dah || !t->silence) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 0;
+    }
+    return 1;
+}
+
+static void free_tone_templates(ToneTemplates *t) {
+    free(t->dit);
+    free(t->dah);
+    free(t->silence);
+}
+
+static void fill_wav_header(unsigned char *h, const AudioSettings *settings, uint32_t data_bytes) {
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, data_bytes > UINT32_MAX - 36 ? UINT32_MAX : data_bytes + 36);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le32(h + 16, 16);                                   // fmt chunk size
+    put_le16(h + 20, 1);                                    // PCM
+    put_le16(h + 22, 1);                                    // mono
+    put_le32(h + 24, (uint32_t)settings->sample_rate);
+    put_le32(h + 28, (uint32_t)settings->sample_rate * 2);  // byte rate
+    put_le16(h + 32, 2);                                    // block align
+    put_le16(h + 34, 16);                                   // bits per sample
+    memcpy(h + 36, "data", 4);
+    put_le32(h + 40, data_bytes);
+}
+
+// Encode text as keyed audio, streaming block copies of the tone templates
+int encode_wav(FILE *input, const char *wav_path, const AudioSettings *settings) {
+    ToneTemplates t;
+    unsigned char header[WAV_HEADER_SIZE];
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    size_t pending_gap = 0;     // silence owed before the next element
+    uint64_t data_bytes = 0;
+    int unsupported_count = 0;
+    int result = EXIT_SUCCESS;
+    FILE *wav = stdout;
+    
+    if (strcmp(wav_path, "-") != 0) {
+        wav = fopen(wav_path, "wb");
+        if (!wav) {
+            fprintf(stderr, "Error: cannot open '%s': %s\n", wav_path, strerror(errno));
+            return EXIT_FILE_ERROR;
+        }
+    }
+    
+    if (!build_tone_templates(&t, settings)) {
+        result = EXIT_FILE_ERROR;
+        goto cleanup;
+    }
+    build_encode_table(" ");
+    
+    // Sizes are unknown while streaming; patched below when the output can seek
+    fill_wav_header(header, settings, UINT32_MAX);
+    if (fwrite(header, 1, sizeof(header), wav) != sizeof(header)) {
+        goto write_error;
+    }
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t chars_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + chars_read;
+        int at_eof = chars_read < want;
+        size_t i = 0;
+        
+        while (i < len) {
+            unsigned char c = buffer[i];
+            
+            if (c == ' ' || c == '\n') {
+                if (pending_gap > 0) {
+                    pending_gap = t.word_gap_bytes;
+                }
+                i++;
+                continue;
+            }
+            
+            size_t consumed;
+            int match = match_symbol(buffer + i, len - i, at_eof, &consumed);
+            if (match == MATCH_NEED_MORE) {
+                break;
+            }
+            if (match == MATCH_UNSUPPORTED) {
+                warn_unsupported(buffer + i, consumed, &unsupported_count);
+                i += consumed;
+                continue;
+            }
+            i += consumed;
+            
+            if (pending_gap > 0 && pending_gap < t.char_gap_bytes) {
+                pending_gap = t.char_gap_bytes;
+            }
+            
+            // The table is built with a space separator, marking letter gaps
+            const EncodeEntry *entry = &encode_entries[match];
+            for (unsigned char e = entry->sep_len; e < entry->joined_len; e++) {
+                if (entry->joined[e] == ' ') {
+                    pending_gap = t.char_gap_bytes;
+                    continue;
+                }
+                
+                const unsigned char *tone = entry->joined[e] == '-' ? t.dah : t.dit;
+                size_t tone_bytes = entry->joined[e] == '-' ? t.dah_bytes : t.dit_bytes;
+                
+                if (fwrite(t.silence, 1, pending_gap, wav) != pending_gap ||
+                    fwrite(tone, 1, tone_bytes, wav) != tone_bytes) {
+                    goto write_error;
+                }
+                data_bytes += pending_gap + tone_bytes;
+                pending_gap = t.element_gap_bytes;
+            }
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+        result = EXIT_FILE_ERROR;
+        goto cleanup;
+    }
+    
+    if (unsupported_count > 10) {
+        fprintf(stderr, "Warning: %d total unsupported characters skipped\n", unsupported_count);
+    }
+    
+    // Trailing word gap so consecutive files do not run together
+    if (pending_gap > 0) {
+        if (fwrite(t.silence, 1, t.word_gap_bytes, wav) != t.word_gap_bytes) {
+            goto write_error;
+        }
+        data_bytes += t.word_gap_bytes;
+    }
+    
+    if (fflush(wav) != 0) {
+        goto write_error;
+    }
+    if (fseek(wav, 0, SEEK_SET) == 0) {
+        fill_wav_header(header, settings, data_bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)data_bytes);
+        if (fwrite(header, 1, sizeof(header), wav) != sizeof(header) || fflush(wav) != 0) {
+            goto write_error;
+        }
+    }
+    goto cleanup;
+
+write_error:
+    fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+    result = EXIT_FILE_ERROR;
+
+cleanup:
+    free_tone_templates(&t);
+    if (wav != stdout && fclose(wav) != 0 && result == EXIT_SUCCESS) {
+        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+        result = EXIT_FILE_ERROR;
+    }
+    return result;
+}
+
+// Unit-timed keying patterns: bit set = key down for one unit, first unit in
+// the most significant position. A composite code has two symbols that are
+// sent with a letter gap between them.
+typedef struct {
+    uint64_t bits[2];
+    unsigned char len[2];       // len[1] is 0 for a single symbol
+} KeyingPattern;
+
+static KeyingPattern keying_patterns[MAX_ENCODE_ENTRIES];
+
+static void build_keying_patterns(void) {
+    for (int i = 0; i < encode_entry_count; i++) {
+        KeyingPattern *p = &keying_patterns[i];
+        int part = 0;
+        
+        memset(p, 0, sizeof(*p));
+        for (const char *m = encode_entries[i].morse; *m; m++) {
+            if (*m == ' ') {
+                part = 1;
+                continue;
+            }
+            if (p->len[part] > 0) {
+                p->bits[part] <<= 1;    // Element gap
+                p->len[part]++;
+            }
+            int units = *m == '-' ? 3 : 1;
+            p->bits[part] = (p->bits[part] << units) | ((1U << units) - 1);
+            p->len[part] += (unsigned char)units;
+        }
+    }
+}
+
+// Packs keying units into bytes; text output spells each unit as '=' or '.'
+typedef struct {
+    uint64_t acc;               // pending units in the low nbits bits
+    int nbits;
+    int text;
+    char out[OUTPUT_BUFFER_SIZE];
+    size_t out_len;
+} KeyingWriter;
+
+// Move whole bytes from the accumulator to the output buffer
+static int keying_drain(KeyingWriter *w, FILE *output) {
+    while (w->nbits >= 8) {
+        if (w->out_len > sizeof(w->out) - 8 && !flush_output(w->out, &w->out_len, output)) {
+            return 0;
+        }
+        w->nbits -= 8;
+        unsigned int byte = (unsigned int)(w->acc >> w->nbits) & 0xFF;
+        if (w->text) {
+            for (int b = 7; b >= 0; b--) {
+                w->out[w->out_len++] = (byte >> b) & 1 ? '=' : '.';
+            }
+        } else {
+            w->out[w->out_len++] = (char)byte;
+        }
+    }
+    return 1;
+}
+
+// Append len (at most 48) units
+static int keying_put(KeyingWriter *w, uint64_t bits, int len, FILE *output) {
+    w->acc = (w->acc << len) | bits;
+    w->nbits += len;
+    return keying_drain(w, output);
+}
+
+static int keying_put_gap(KeyingWriter *w, size_t units, FILE *output) {
+    while (units > 0) {
+        int n = units > 48 ? 48 : (int)units;
+        if (!keying_put(w, 0, n, output)) {
+            return 0;
+        }
+        units -= (size_t)n;
+    }
+    return 1;
+}
+
+// Encode text as a unit-timed keying signal: packed bits (bitstream) or
+// '='/'.' text (timing). Letter and word gaps follow --farnsworth.
+int encode_keying(FILE *input, FILE *output, int text, const AudioSettings *settings) {
+    static KeyingWriter writer;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    size_t pending_gap = 0;     // key-up units owed before the next character
+    int unsupported_count = 0;
+    KeyingWriter *w = &writer;
+    
+    double gap_ratio = gap_unit_seconds(settings) * settings->wpm / 1.2;
+    size_t letter_gap = (size_t)lround(3.0 * gap_ratio);
+    size_t word_gap = (size_t)lround(7.0 * gap_ratio);
+    
+    build_keying_patterns();
+    memset(w, 0, sizeof(*w));
+    w->text = text;
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t chars_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + chars_read;
+        int at_eof = chars_read < want;
+        size_t i = 0;
+        
+        while (i < len) {
+            unsigned char c = buffer[i];
+            
+            if (c == ' ' || c == '\n') {
+                if (pending_gap > 0) {
+                    pending_gap = word_gap;
+                }
+                i++;
+                continue;
+            }
+            
+            size_t consumed;
+            int match = match_symbol(buffer + i, len - i, at_eof, &consumed);
+            if (match == MATCH_NEED_MORE) {
+                break;
+            }
+            if (match == MATCH_UNSUPPORTED) {
+                warn_unsupported(buffer + i, consumed, &unsupported_count);
+                i += consumed;
+                continue;
+            }
+            i += consumed;
+            
+            const KeyingPattern *p = &keying_patterns[match];
+            if (!keying_put_gap(w, pending_gap, output) ||
+                !keying_put(w, p->bits[0], p->len[0], output)) {
+                return EXIT_FILE_ERROR;
+            }
+            if (p->len[1] > 0 && (!keying_put_gap(w, letter_gap, output) ||
+                                  !keying_put(w, p->bits[1], p->len[1], output))) {
+                return EXIT_FILE_ERROR;
+            }
+            pending_gap = letter_gap;
+        }
+        
+        carry = len - i;
+        memmove(buffer, buffer + i, carry);
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    if (ferror(input)) {
+        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+        return EXIT_FILE_ERROR;
+    }
+    
+    if (unsupported_count > 10) {
+        fprintf(stderr, "Warning: %d total unsupported characters skipped\n", unsupported_count);
+    }
+    
+    // Trailing word gap so consecutive files do not run together
+    if (pending_gap > 0 && !keying_put_gap(w, word_gap, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    // Last partial byte: key-up padding, or only the real units as text,
+    // plus the newline; drain may have left fewer bytes free than that
+    if (w->out_len > sizeof(w->out) - 9 && !flush_output(w->out, &w->out_len, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    if (w->nbits > 0) {
+        if (text) {
+            for (int b = w->nbits - 1; b >= 0; b--) {
+                w->out[w->out_len++] = (w->acc >> b) & 1 ? '=' : '.';
+            }
+        } else {
+            w->out[w->out_len++] = (char)((w->acc << (8 - w->nbits)) & 0xFF);
+        }
+    }
+    if (text) {
+        w->out[w->out_len++] = '\n';
+    }
+    if (!flush_output(w->out, &w->out_len, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+// Nearest-code table for --fuzzy, indexed by MORSE_KEY like the decode table
+typedef struct {
+    const char *text;           // nearest character, NULL if unreachable
+    unsigned char distance;     // edit distance in elements
+    unsigned char confidence;   // percent of the longer code left unedited
+} FuzzyEntry;
+
+typedef struct {
+    FuzzyEntry *table;          // NULL unless --fuzzy is active
+    int max_len;
+    int corrected;
+    long confidence_sum;
+    int lowest_confidence;
+} FuzzyDecoder;
+
+static FuzzyDecoder fuzzy;
+
+// Longest symbol kept while decoding; longer ones are truncated
+static int max_symbol_length = MAX_MORSE_LENGTH;
+
+static int key_length(uint32_t key) {
+    return 31 - __builtin_clz(key);
+}
+
+// Compute the nearest valid code for every sequence of up to max_len
+// elements. Edit distance has unit costs, so a breadth-first search from all
+// valid codes at once labels each sequence with its distance; an optimal
+// edit path never needs a sequence longer than both ends, so the search
+// stays within a table that also holds every valid code.
+static int build_fuzzy_table(int max_len) {
+    int table_len = max_len > MAX_MORSE_LENGTH ? max_len : MAX_MORSE_LENGTH;
+    uint32_t size = 1U << (table_len + 1);
+    uint32_t *queue = malloc(size * sizeof(*queue));
+    uint32_t *source = malloc(size * sizeof(*source));
+    FuzzyEntry *table = calloc(size, sizeof(*table));
+    size_t head = 0, tail = 0;
+    
+    if (!queue || !source || !table) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(queue);
+        free(source);
+        free(table);
+        return 0;
+    }
+    
+    for (uint32_t key = 1; key < size; key++) {
+        table[key].distance = UCHAR_MAX;
+        int len = key_length(key);
+        if (len >= 1 && len <= MAX_MORSE_LENGTH && morse_decode_table[key]) {
+            table[key].text = morse_decode_table[key];
+            table[key].distance = 0;
+            source[key] = key;
+            queue[tail++] = key;
+        }
+    }
+    
+    while (head < tail) {
+        uint32_t key = queue[head++];
+        int len = key_length(key);
+        uint32_t bits = key ^ (1U << len);
+        uint32_t next[4 * MAX_FUZZY_LENGTH + 2];
+        int count = 0;
+        
+        for (int i = 0; i < len; i++) {
+            // Flip or delete element i
+            uint32_t low = bits & ((1U << i) - 1);
+            next[count++] = MORSE_KEY(len, bits ^ (1U << i));
+            next[count++] = MORSE_KEY(len - 1, low | ((bits >> (i + 1)) << i));
+        }
+        if (len < table_len) {
+            for (int i = 0; i <= len; i++) {
+                // Insert a dot or a dash before element i
+                uint32_t low = bits & ((1U << i) - 1);
+                uint32_t high = (bits >> i) << (i + 1);
+                next[count++] = MORSE_KEY(len + 1, low | high);
+                next[count++] = MORSE_KEY(len + 1, low | high | (1U << i));
+            }
+        }
+        
+        for (int n = 0; n < count; n++) {
+            if (table[next[n]].distance == UCHAR_MAX) {
+                table[next[n]].text = table[key].text;
+                table[next[n]].distance = (unsigned char)(table[key].distance + 1);
+                source[next[n]] = source[key];
+                queue[tail++] = next[n];
+            }
+        }
+    }
+    
+    for (uint32_t key = 2; key < size; key++) {
+        int longer = key_length(key) > key_length(source[key]) ? key_length(key) : key_length(source[key]);
+        int left = longer - table[key].distance;
+        table[key].confidence = (unsigned char)(left > 0 ? 100 * left / longer : 0);
+    }
+    
+    free(queue);
+    free(source);
+    fuzzy.table = table;
+    fuzzy.max_len = max_len;
+    fuzzy.lowest_confidence = 100;
+    max_symbol_length = table_len;
+    return 1;
+}
+
+static void report_fuzzy(void) {
+    if (fuzzy.corrected > 0) {
+        fprintf(stderr, "Warning: %d morse sequences corrected, mean confidence %ld%%, lowest %d%%\n",
+                fuzzy.corrected, fuzzy.confidence_sum / fuzzy.corrected, fuzzy.lowest_confidence);
+    }
+}
+
+static void format_morse(char *morse, int len, unsigned int bits) {
+    for (int i = 0; i < len; i++) {
+        morse[i] = (bits >> i) & 1 ? '-' : '.';
+    }
+    morse[len] = '\0';
+}
+
+// Decode one accumulated symbol, warning about unknown sequences
+static const char *decode_symbol(int len, unsigned int bits, int *invalid_sequences) {
+    const char *decoded = morse_to_text(len, bits);
+    char morse[MAX_FUZZY_LENGTH + 1];
+    
+    if (!decoded && fuzzy.table && len <= fuzzy.max_len) {
+        const FuzzyEntry *entry = &fuzzy.table[MORSE_KEY(len, bits)];
+        if (entry->text) {
+            fuzzy.corrected++;
+            fuzzy.confidence_sum += entry->confidence;
+            if (entry->confidence < fuzzy.lowest_confidence) {
+                fuzzy.lowest_confidence = entry->confidence;
+            }
+            if (fuzzy.corrected <= 10) {
+                format_morse(morse, len, bits);
+                fprintf(stderr, "Warning: read morse sequence '%s' as '%s' (confidence %d%%)\n",
+                        morse, entry->text, entry->confidence);
+            }
+            return entry->text;
+        }
+    }
+    
+    if (!decoded) {
+        decoded = "?";
+        (*invalid_sequences)++;
+        if (*invalid_sequences <= 10) {
+            format_morse(morse, len, bits);
+            fprintf(stderr, "Warning: unknown morse sequence '%s'\n", morse);
+        }
+    }
+    
+    return decoded;
+}
+
+// Byte classes for the decode tokenizer
+#define TOKEN_DOT       0x01
+#define TOKEN_DASH      0x02
+#define TOKEN_NEWLINE   0x04
+#define TOKEN_CHAR_SEP  0x08    // single-byte character separator (default mode)
+#define TOKEN_WORD_SEP  0x10    // single-byte word separator (default mode)
+#define TOKEN_SEP_START 0x20    // may start a custom separator
+
+#define TOKEN_BLOCK 32
+
+// Decoder state; separators are NULL for the default space/tab and '/' rules
+typedef struct {
+    unsigned char classes[256];
+    const char *long_sep;       // custom separators, longest first
+    const char *short_sep;
+    size_t long_len;
+    size_t short_len;
+    int long_is_word;
+    int symbol_len;
+    unsigned int symbol_bits;
+    int invalid_sequences;
+    char out[OUTPUT_BUFFER_SIZE];
+    size_t out_len;
+} MorseDecoder;
+
+// Custom separators must not be mistaken for morse elements or line breaks
+int validate_decode_separator(const char *sep, const char *name) {
+    if (sep[0] == '\0' || strpbrk(sep, ".-\n")) {
+        fprintf(stderr, "Error: %s for decoding must be non-empty and not contain '.', '-' or newline\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+static void init_decoder(MorseDecoder *d, const char *char_sep, const char *word_sep) {
+    memset(d->classes, 0, sizeof(d->classes));
+    d->classes['.'] = TOKEN_DOT;
+    d->classes['-'] = TOKEN_DASH;
+    d->classes['\n'] = TOKEN_NEWLINE;
+    d->long_sep = NULL;
+    d->short_sep = NULL;
+    d->long_len = 0;
+    d->short_len = 0;
+    d->long_is_word = 0;
+    
+    if (!char_sep) {
+        d->classes[' '] = TOKEN_CHAR_SEP;
+        d->classes['\t'] = TOKEN_CHAR_SEP;
+        d->classes['/'] = TOKEN_WORD_SEP;
+    } else {
+        // Try the longer separator first so one may be a prefix of the other
+        int word_first = strlen(word_sep) >= strlen(char_sep);
+        d->long_sep = word_first ? word_sep : char_sep;
+        d->short_sep = word_first ? char_sep : word_sep;
+        d->long_len = strlen(d->long_sep);
+        d->short_len = strlen(d->short_sep);
+        d->long_is_word = word_first;
+        d->classes[(unsigned char)char_sep[0]] = TOKEN_SEP_START;
+        d->classes[(unsigned char)word_sep[0]] = TOKEN_SEP_START;
+    }
+    
+    d->symbol_len = 0;
+    d->symbol_bits = 0;
+    d->invalid_sequences = 0;
+    d->out_len = 0;
+}
+
+// Append one byte of decoded text, flushing when the buffer is full
+static int decoder_put(MorseDecoder *d, char c, FILE *output) {
+    if (d->out_len == sizeof(d->out) && !flush_output(d->out, &d->out_len, output)) {
+        return 0;
+    }
+    d->out[d->out_len++] = c;
+    return 1;
+}
+
+// Emit the pending symbol, if any
+static int decoder_end_symbol(MorseDecoder *d, FILE *output) {
+    if (d->symbol_len == 0) {
+        return 1;
+    }
+    const char *text = decode_symbol(d->symbol_len, d->symbol_bits, &d->invalid_sequences);
+    d->symbol_len = 0;
+    d->symbol_bits = 0;
+    while (*text) {
+        if (!decoder_put(d, *text++, output)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Append a run of elements whose dash flags are the low run bits of dashes
+static void decoder_add_elements(MorseDecoder *d, uint32_t dashes, int run) {
+    if (d->symbol_len + run <= max_symbol_length) {
+        d->symbol_bits |= (dashes & (uint32_t)((1ULL << run) - 1)) << d->symbol_len;
+        d->symbol_len += run;
+        return;
+    }
+    
+    for (int i = 0; i < run; i++) {
+        if (d->symbol_len < max_symbol_length) {
+            d->symbol_bits |= ((dashes >> i) & 1U) << d->symbol_len;
+            d->symbol_len++;
+        } else {
+            fprintf(stderr, "Warning: morse sequence too long, truncating\n");
+            d->symbol_len = 0;  // Reset buffer
+            d->symbol_bits = 0;
+        }
+    }
+}
+
+// Classify TOKEN_BLOCK bytes (fewer at the end of the buffer) into bit masks
+static void classify_block(const MorseDecoder *d, const unsigned char *p, size_t n,
+                           uint32_t *elements, uint32_t *dashes, uint32_t *stops) {
+    uint32_t e = 0, h = 0, s = 0;
+    for (size_t j = 0; j < n; j++) {
+        uint32_t c = d->classes[p[j]];
+        e |= (uint32_t)((c & (TOKEN_DOT | TOKEN_DASH)) != 0) << j;
+        h |= (uint32_t)((c & TOKEN_DASH) != 0) << j;
+        s |= (uint32_t)(c != 0) << j;
+    }
+    *elements = e;
+    *dashes = h;
+    *stops = s;
+}
+
+// Decode len bytes of buf. Returns the number of bytes consumed; a possible
+// separator cut off by the end of the buffer is left for the next call
+// unless at_eof is set. Returns (size_t)-1 on write error.
+static size_t decode_buffer(MorseDecoder *d, const unsigned char *buf, size_t len,
+                            int at_eof, FILE *output) {
+    size_t base = 0;
+    
+    while (base < len) {
+        size_t n = len - base < TOKEN_BLOCK ? len - base : TOKEN_BLOCK;
+        uint32_t elements, dashes, stops;
+        classify_block(d, buf + base, n, &elements, &dashes, &stops);
+        
+        size_t pos = 0;
+        size_t next = base + n;
+        while (pos < n) {
+            uint32_t pending = stops >> pos;
+            if (pending == 0) {
+                break;  // Rest of the block is ignored bytes
+            }
+            pos += (size_t)__builtin_ctz(pending);
+            
+            if ((elements >> pos) & 1U) {
+                // Consume the whole run of dots and dashes at once
+                int run = __builtin_ctzll(~((uint64_t)elements >> pos));
+                decoder_add_elements(d, dashes >> pos, run);
+                pos += (size_t)run;
+                continue;
+            }
+            
+            size_t at = base + pos;
+            unsigned char cls = d->classes[buf[at]];
+            size_t skip = 1;
+            int is_word = 0;
+            
+            if (cls == TOKEN_SEP_START) {
+                size_t left = len - at;
+                if (!at_eof && left < d->long_len) {
+                    return at;  // Wait for the rest of a possible separator
+                }
+                if (left >= d->long_len && memcmp(buf + at, d->long_sep, d->long_len) == 0) {
+                    skip = d->long_len;
+                    is_word = d->long_is_word;
+                } else if (left >= d->short_len && memcmp(buf + at, d->short_sep, d->short_len) == 0) {
+                    skip = d->short_len;
+                    is_word = !d->long_is_word;
+                } else {
+                    pos++;
+                    continue;  // Not a separator after all; ignore the byte
+                }
+            } else {
+                is_word = cls == TOKEN_WORD_SEP;
+            }
+            
+            if (!decoder_end_symbol(d, output)) {
+                return (size_t)-1;
+            }
+            if (is_word && !decoder_put(d, ' ', output)) {  // Word separator becomes space
+                return (size_t)-1;
+            }
+            if (cls == TOKEN_NEWLINE && !decoder_put(d, '\n', output)) {  // Preserve newlines
+                return (size_t)-1;
+            }
+            
+            if (pos + skip > n) {
+                next = at + skip;  // Separator ran into the following block
+                break;
+            }
+            pos += skip;
+        }
+        base = next;
+    }
+    
+    return len;
+}
+
+// Decode morse code to text with buffering. With NULL separators, spaces and
+// tabs separate characters and '/' separates words; otherwise exactly the
+// given separators are recognised. Newlines are preserved either way.
+int decode_morse(FILE *input, FILE *output, const char *char_sep, const char *word_sep) {
+    static MorseDecoder decoder;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t carry = 0;
+    MorseDecoder *d = &decoder;
+    
+    init_decoder(d, char_sep, word_sep);
+    
+    for (;;) {
+        size_t want = sizeof(buffer) - carry;
+        size_t chars_read = fread(buffer + carry, 1, want, input);
+        size_t len = carry + chars_read;
+        int at_eof = chars_read < want;
+        
+        if (len == 0) {
+            break;
+        }
+        
+        size_t consumed = decode_buffer(d, buffer, len, at_eof, output);
+        if (consumed == (size_t)-1) {
+            return EXIT_FILE_ERROR;
+        }
+        carry = len - consumed;
+        memmove(buffer, buffer + consumed, carry);
+        
+        if (at_eof) {
+            break;
+        }
+    }
+    
+    // Check for read error
+    if (ferror(input)) {
+        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+        return EXIT_FILE_ERROR;
+    }
+    
+    // Handle any remaining morse in buffer
+    if (!decoder_end_symbol(d, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    if (d->invalid_sequences > 10) {
+        fprintf(stderr, "Warning: %d total invalid morse sequences found\n", d->invalid_sequences);
+    }
+    
+    if (!decoder_put(d, '\n', output) || !flush_output(d->out, &d->out_len, output)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+// Turns timed key-down/key-up events into text. The first marks and the
+// gaps between them are held back until the unit they fit best is known,
+// so the opening letters do not depend on how close the --wpm seed was.
+// From then on marks keep two cluster centres (dit, dah) and spaces three
+// (element, letter and word gap) that follow the sender's speed; every
+// event is classified against the midpoints between neighbouring centres
+// and then pulls its own centre towards it. Each update also carries the
+// neighbouring centre along, and gaps are tied to the dit, so a centre that
+// sees no samples still follows the sender instead of staying behind.
+// Farnsworth gaps are only recognised with a matching --farnsworth: a
+// uniformly stretched letter gap looks just like a word gap.
+#define KEYING_BOOTSTRAP_MARKS 12
+
 typedef struct {
-    char character;
-    const char* morse;
-} MorseEntry;
+    double dit;
+    double dah;
+    double element_gap;
+    double letter_gap;
+    double word_gap;
+    double gap_stretch;         // gap unit over the dit, from --farnsworth
+    double seconds_per_tick;
+    int farnsworth_wpm;
+    int symbol_len;
+    unsigned int symbol_bits;
+    int invalid_sequences;
+    int at_word_start;          // suppresses repeated word spaces
+    int space_pending;          // word space written once the next mark arrives
+    int bootstrapped;
+    int held_len;
+    int held_marks;
+    double held[2 * KEYING_BOOTSTRAP_MARKS];    // signed durations awaiting the first estimate
+} KeyingDecoder;
 
-// Standard International Morse Code
-static const MorseEntry morse_table[] = {
-    // Letters
-    {'A', ".-"}, {'B', "-..."}, {'C', "-.-."}, {'D', "-.."}, {'E', "."}, {'F', "..-."}, 
-    {'G', "--."}, {'H', "...."}, {'I', ".."}, {'J', ".---"}, {'K', "-.-"}, {'L', ".-.."}, 
-    {'M', "--"}, {'N', "-."}, {'O', "---"}, {'P', ".--."}, {'Q', "--.-"}, {'R', ".-."}, 
-    {'S', "..."}, {'T', "-"}, {'U', "..-"}, {'V', "...-"}, {'W', ".--"}, {'X', "-..-"}, 
-    {'Y', "-.--"}, {'Z', "--.."}, 
-    // Numbers
-    {'0', "-----"}, {'1', ".----"}, {'2', "..---"}, {'3', "...--"}, {'4', "....-"}, 
-    {'5', "....."}, {'6', "-...."}, {'7', "--..."}, {'8', "---.."}, {'9', "----."},
-    // Punctuation
-    {'.', ".-.-.-"}, {',', "--..--"}, {'?', "..--.."}, {'\'', ".----."}, {'!', "-.-.--"},
-    {'/', "-..-."}, {'(', "-.--."}, {')', "-.--.-"}, {'&', ".-..."}, {':', "---..."},
-    {';', "-.-.-."}, {'=', "-...-"}, {'+', ".-.-."}, {'-', "-....-"}, {'_', "..--.-"},
-    {'"', ".-..-."}, {'$', "...-..-"}, {'@', ".--.-."}, {' ', "/"},  // Space as separator
-    {'\0', NULL}  // End marker
-};
+#define KEYING_ADAPT_RATE 0.2
+#define KEYING_RATIO_RATE 0.05
 
-void print_usage(const char *program_name) {
-    printf("Usage: %s [OPTION]... [FILE]\n", program_name);
-    printf("Morse code encode or decode FILE, or standard input, to standard output.\n");
-    printf("With no FILE, or when FILE is -, read standard input.\n\n");
-    printf("  -d, --decode          decode morse code (convert morse to text)\n");
-    printf("  -s, --separator=SEP   character separator for encoding (default: space)\n");
-    printf("  -w, --word-sep=SEP    word separator for encoding (default: ' / ')\n");
-    printf("      --help           display this help and exit\n");
-    printf("      --version        output version information and exit\n\n");
-    printf("Encoding: Converts readable text to morse code using dots and dashes\n");
-    printf("Decoding: Converts morse code back to text (use spaces between letters, '/' between words)\n");
-    printf("Supported: A-Z, 0-9, and common punctuation marks\n");
+// Seed the centres from the expected speed, in whatever time unit the
+// caller measures durations with
+static void keying_init(KeyingDecoder *k, const AudioSettings *settings, double seconds_per_tick) {
+    double unit = 1.2 / settings->wpm / seconds_per_tick;
+    double gap_unit = gap_unit_seconds(settings) / seconds_per_tick;
+    
+    memset(k, 0, sizeof(*k));
+    k->dit = unit;
+    k->dah = 3.0 * unit;
+    k->element_gap = unit;
+    k->letter_gap = 3.0 * gap_unit;
+    k->word_gap = 7.0 * gap_unit;
+    k->gap_stretch = gap_unit / unit;
+    k->seconds_per_tick = seconds_per_tick;
+    k->farnsworth_wpm = settings->farnsworth_wpm;
+    k->at_word_start = 1;
 }
 
-void print_version() {
-    printf("morse 1.0\n");
-    printf("Simple morse code encoder/decoder\n");
+static double clamp(double value, double low, double high) {
+    return value < low ? low : value > high ? high : value;
 }
 
-// Validate separator string
-int validate_separator(const char *sep, const char *name) {
-    if (!sep) {
-        fprintf(stderr, "Error: %s cannot be null\n", name);
-        return 0;
+// Move a centre towards a sample. A change of speed scales both centres
+// of the pair together; the ratio between them adapts more slowly, within
+// min_ratio..max_ratio.
+static void keying_update(double *low, double *high, int is_high, double duration,
+                          double min_ratio, double max_ratio) {
+    double *centre = is_high ? high : low;
+    double *partner = is_high ? low : high;
+    double scale = 1.0 + KEYING_ADAPT_RATE * (duration / *centre - 1.0);
+    
+    *centre *= scale;
+    *partner *= scale;
+    *centre += KEYING_RATIO_RATE * (duration - *centre);
+    if (is_high) {
+        *low = clamp(*low, *high / max_ratio, *high / min_ratio);
+    } else {
+        *high = clamp(*high, *low * min_ratio, *low * max_ratio);
     }
-    if (strlen(sep) > MAX_SEPARATOR_LENGTH) {
-        fprintf(stderr, "Error: %s too long (max %d chars)\n", name, MAX_SEPARATOR_LENGTH);
+}
+
+// Gaps follow the mark speed: an element gap is about a dit, and letter
+// and word gaps stay near 3 and 7 (stretched) units, with room for hand
+// keying either way
+static void keying_anchor_gaps(KeyingDecoder *k) {
+    double gap_unit = k->gap_stretch * k->dit;
+    
+    k->element_gap = clamp(k->element_gap, 0.75 * k->dit, 1.5 * k->dit);
+    k->letter_gap = clamp(k->letter_gap, 2.5 * gap_unit, 3.5 * gap_unit);
+    k->word_gap = clamp(k->word_gap, 5.5 * gap_unit, 9.0 * gap_unit);
+}
+
+static int keying_flush_symbol(KeyingDecoder *k, FILE *output) {
+    if (k->symbol_len == 0) {
+        return 1;
+    }
+    
+    const char *decoded = decode_symbol(k->symbol_len, k->symbol_bits, &k->invalid_sequences);
+    k->symbol_len = 0;
+    k->symbol_bits = 0;
+    k->at_word_start = 0;
+    if (fputs(decoded, output) == EOF) {
+        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
         return 0;
     }
     return 1;
 }
 
-// Find morse code for a character
-const char* char_to_morse(char c) {
-    c = toupper(c);  // Convert to uppercase
-    for (int i = 0; morse_table[i].character != '\0'; i++) {
-        if (morse_table[i].character == c) {
-            return morse_table[i].morse;
+// Key-down of the given duration: a dit or a dah
+static int keying_mark(KeyingDecoder *k, double duration, FILE *output) {
+    if (k->space_pending) {
+        k->space_pending = 0;
+        if (!safe_fputc(' ', output)) {
+            return 0;
         }
     }
-    return NULL;  // Character not found
-}
-
-// Find character for morse code
-char morse_to_char(const char* morse) {
-    if (!morse) return '?';
     
-    for (int i = 0; morse_table[i].character != '\0'; i++) {
-        if (strcmp(morse_table[i].morse, morse) == 0) {
-            return morse_table[i].character;
-        }
+    int is_dah = duration > 0.5 * (k->dit + k->dah);
+    double dit = k->dit;
+    keying_update(&k->dit, &k->dah, is_dah, duration, 2.0, 4.0);
+    
+    // A change of speed shows up in the marks first; carry the gaps along
+    double scale = k->dit / dit;
+    k->element_gap *= scale;
+    k->letter_gap *= scale;
+    k->word_gap *= scale;
+    keying_anchor_gaps(k);
+    
+    if (k->symbol_len < max_symbol_length) {
+        k->symbol_bits |= (unsigned int)is_dah << k->symbol_len;
+        k->symbol_len++;
+    } else {
+        fprintf(stderr, "Warning: morse sequence too long, truncating\n");
+        k->symbol_len = 0;
+        k->symbol_bits = 0;
     }
-    return '?';  // Morse not found
+    return 1;
 }
 
-// Safe output functions
-int safe_fputs(const char *str, FILE *stream) {
-    if (fputs(str, stream) == EOF) {
-        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+// Key-up of the given duration: element, letter or word gap
+static int keying_space(KeyingDecoder *k, double duration, FILE *output) {
+    if (duration <= 0.5 * (k->element_gap + k->letter_gap)) {
+        k->element_gap += KEYING_ADAPT_RATE * (duration - k->element_gap);
+        keying_anchor_gaps(k);
+        return 1;
+    }
+    
+    int is_word = duration > 0.5 * (k->letter_gap + k->word_gap);
+    keying_update(&k->letter_gap, &k->word_gap, is_word, duration, 1.5, 3.5);
+    keying_anchor_gaps(k);
+    
+    if (!keying_flush_symbol(k, output)) {
         return 0;
     }
+    // A trailing word gap must not leave a space before the newline
+    if (is_word && !k->at_word_start) {
+        k->at_word_start = 1;
+        k->space_pending = 1;
+    }
     return 1;
 }
 
-int safe_fputc(int c, FILE *stream) {
-    if (fputc(c, stream) == EOF) {
-        fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
-        return 0;
+static int keying_classify(KeyingDecoder *k, double duration, FILE *output) {
+    return duration > 0 ? keying_mark(k, duration, output) : keying_space(k, -duration, output);
+}
+
+// Farnsworth spacing stretches the gaps by an amount that depends on the
+// character speed, so it is worked out again for each candidate unit
+static double keying_stretch(const KeyingDecoder *k, double unit) {
+    double unit_seconds = unit * k->seconds_per_tick;
+    return gap_unit_at(1.2 / unit_seconds, k->farnsworth_wpm) / unit_seconds;
+}
+
+// Squared log distance from a duration to the nearest nominal length in
+// units; gaps longer than a word gap are word gaps too. Capped so a single
+// glitch cannot outweigh the rest.
+static double keying_fit(double duration, double unit, double stretch) {
+    static const double mark_lengths[] = {1.0, 3.0};
+    double gap_lengths[] = {1.0, 3.0 * stretch, 7.0 * stretch};
+    const double *lengths = duration > 0 ? mark_lengths : gap_lengths;
+    int count = duration > 0 ? 2 : 3;
+    double units = fabs(duration) / unit;
+    double best = 1.0;
+    
+    if (duration < 0 && units >= gap_lengths[2]) {
+        return 0.0;
     }
-    return 1;
+    for (int i = 0; i < count; i++) {
+        double d = log(units / lengths[i]);
+        if (d * d < best) {
+            best = d * d;
+        }
+    }
+    return best;
 }
 
-// Encode text to morse code with buffering
-int encode_morse(FILE *input, FILE *output, const char *char_sep, const char *word_sep) {
-    char buffer[BUFFER_SIZE];
-    size_t chars_read;
-    int first_char = 1;
-    int word_started = 0;
-    int unsupported_count = 0;
+// Pick the unit that explains the held-back events best: every mark is a
+// candidate dit or dah and every gap a candidate element gap. Readings that
+// fit equally well ("E E" against "T T") go to the one nearest the seed.
+// The winner is refined over the marks, the centres are reseeded from it
+// and the held events are decoded.
+static int keying_bootstrap(KeyingDecoder *k, FILE *output) {
+    double seed = k->dit;
+    double best_unit = seed;
+    double best_cost = HUGE_VAL;
     
-    while ((chars_read = fread(buffer, 1, sizeof(buffer), input)) > 0) {
-        for (size_t i = 0; i < chars_read; i++) {
-            char c = buffer[i];
-            
-            if (c == '\n') {
-                if (!safe_fputc('\n', output)) {
-                    return EXIT_FILE_ERROR;
-                }
-                first_char = 1;
-                word_started = 0;
-                continue;
+    for (int i = 0; i < k->held_len; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (j == 1 && k->held[i] < 0) {
+                break;
+            }
+            double unit = fabs(k->held[i]) / (j == 0 ? 1.0 : 3.0);
+            double stretch = keying_stretch(k, unit);
+            double cost = 0.0;
+            for (int e = 0; e < k->held_len; e++) {
+                cost += keying_fit(k->held[e], unit, stretch);
             }
             
-            const char* morse = char_to_morse(c);
-            if (morse) {
-                if (c == ' ') {
-                    // Space becomes word separator
-                    if (word_started) {
-                        if (!safe_fputs(word_sep, output)) {
-                            return EXIT_FILE_ERROR;
-                        }
-                        word_started = 0;
-                    }
-                    first_char = 1;
-                } else {
-                    // Regular character
-                    if (!first_char) {
-                        if (!safe_fputs(char_sep, output)) {
-                            return EXIT_FILE_ERROR;
-                        }
-                    }
-                    if (!safe_fputs(morse, output)) {
-                        return EXIT_FILE_ERROR;
-                    }
-                    first_char = 0;
-                    word_started = 1;
-                }
-            } else {
-                // Unsupported character - skip with warning to stderr
-                unsupported_count++;
-                if (unsupported_count <= 10) {  // Limit error messages
-                    fprintf(stderr, "Warning: skipping unsupported character '%c' (0x%02X)\n", 
-                            isprint(c) ? c : '?', (unsigned char)c);
-                }
+            double tolerance = 0.01 * k->held_len;
+            if (cost < best_cost - tolerance ||
+                (cost <= best_cost + tolerance && fabs(log(unit / seed)) < fabs(log(best_unit / seed)))) {
+                best_unit = unit;
+                best_cost = cost < best_cost ? cost : best_cost;
             }
         }
     }
     
-    // Check for read error
-    if (ferror(input)) {
-        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
-        return EXIT_FILE_ERROR;
+    double log_error = 0.0;
+    int marks = 0;
+    for (int i = 0; i < k->held_len; i++) {
+        if (k->held[i] > 0) {
+            double units = k->held[i] / best_unit;
+            log_error += log(units / (units > sqrt(3.0) ? 3.0 : 1.0));
+            marks++;
+        }
+    }
+    if (marks > 0) {
+        best_unit *= exp(log_error / marks);
     }
     
-    if (unsupported_count > 10) {
-        fprintf(stderr, "Warning: %d total unsupported characters skipped\n", unsupported_count);
+    k->gap_stretch = keying_stretch(k, best_unit);
+    k->dit = best_unit;
+    k->dah = 3.0 * best_unit;
+    k->element_gap = best_unit;
+    k->letter_gap = 3.0 * k->gap_stretch * best_unit;
+    k->word_gap = 7.0 * k->gap_stretch * best_unit;
+    k->bootstrapped = 1;
+    
+    for (int i = 0; i < k->held_len; i++) {
+        if (!keying_classify(k, k->held[i], output)) {
+            return 0;
+        }
+    }
+    k->held_len = 0;
+    return 1;
+}
+
+// Signed duration: positive for key down, negative for key up, zero ignored
+static int keying_event(KeyingDecoder *k, double duration, FILE *output) {
+    if (duration == 0) {
+        return 1;
+    }
+    if (k->bootstrapped) {
+        return keying_classify(k, duration, output);
     }
     
-    if (!safe_fputc('\n', output)) {
-        return EXIT_FILE_ERROR;
+    // Silence before the first mark says nothing about the speed
+    if (duration < 0 && k->held_len == 0) {
+        return 1;
+    }
+    k->held[k->held_len++] = duration;
+    k->held_marks += duration > 0;
+    if (k->held_marks < KEYING_BOOTSTRAP_MARKS && k->held_len < 2 * KEYING_BOOTSTRAP_MARKS) {
+        return 1;
+    }
+    return keying_bootstrap(k, output);
+}
+
+static int keying_finish(KeyingDecoder *k, FILE *output) {
+    if (!k->bootstrapped && k->held_len > 0 && !keying_bootstrap(k, output)) {
+        return 0;
+    }
+    if (!keying_flush_symbol(k, output)) {
+        return 0;
+    }
+    if (k->invalid_sequences > 10) {
+        fprintf(stderr, "Warning: %d total invalid morse sequences found\n", k->invalid_sequences);
+    }
+    return safe_fputc('\n', output);
+}
+
+typedef struct {
+    int channels;
+    int bits;
+    int sample_rate;
+    uint64_t data_bytes;        // UINT64_MAX when the header leaves it open
+} WavFormat;
+
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Parse RIFF chunks up to the start of the PCM data
+static int read_wav_header(FILE *input, WavFormat *fmt) {
+    unsigned char riff[12];
+    unsigned char chunk[8];
+    int have_fmt = 0;
+    
+    if (fread(riff, 1, sizeof(riff), input) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "Error: input is not a WAV file\n");
+        return 0;
     }
     
-    return EXIT_SUCCESS;
+    while (fread(chunk, 1, sizeof(chunk), input) == sizeof(chunk)) {
+        uint32_t size = get_le32(chunk + 4);
+        
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            unsigned char body[16];
+            if (size < sizeof(body) || fread(body, 1, sizeof(body), input) != sizeof(body)) {
+                break;
+            }
+            int format = body[0] | (body[1] << 8);
+            fmt->channels = body[2] | (body[3] << 8);
+            fmt->sample_rate = (int)get_le32(body + 4);
+            fmt->bits = body[14] | (body[15] << 8);
+            if (format != 1 || fmt->channels < 1 || fmt->sample_rate < 1 ||
+                (fmt->bits != 8 && fmt->bits != 16)) {
+                fprintf(stderr, "Error: only 8- or 16-bit PCM WAV input is supported\n");
+                return 0;
+            }
+            have_fmt = 1;
+            size -= sizeof(body);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt) {
+                break;
+            }
+            fmt->data_bytes = size == UINT32_MAX ? UINT64_MAX : size;
+            return 1;
+        }
+        
+        // Skip the rest of this chunk (chunks are padded to even sizes)
+        for (uint64_t skip = (uint64_t)size + (size & 1); skip > 0; skip--) {
+            if (fgetc(input) == EOF) {
+                break;
+            }
+        }
+    }
+    
+    fprintf(stderr, "Error: malformed WAV file\n");
+    return 0;
 }
 
-// Decode morse code to text with buffering
-int decode_morse(FILE *input, FILE *output) {
-    char buffer[BUFFER_SIZE];
-    char morse_buffer[MAX_MORSE_LENGTH + 1] = {0};
-    size_t chars_read;
-    int buffer_pos = 0;
-    int invalid_sequences = 0;
+// Decode keyed audio: a per-block DFT bin at the tone frequency, an adaptive
+// threshold with hysteresis, and the online keying decoder
+int decode_wav(FILE *input, FILE *output, const AudioSettings *settings) {
+    WavFormat fmt = {0};
+    unsigned char raw[BUFFER_SIZE];
+    int result = EXIT_SUCCESS;
+    
+    if (!read_wav_header(input, &fmt)) {
+        return EXIT_INVALID_DATA;
+    }
+    if (settings->tone_hz * 2 >= fmt.sample_rate) {
+        fprintf(stderr, "Error: tone frequency must be below half the sample rate\n");
+        return EXIT_INVALID_ARGS;
+    }
     
-    while ((chars_read = fread(buffer, 1, sizeof(buffer), input)) > 0) {
-        for (size_t i = 0; i < chars_read; i++) {
-            char c = buffer[i];
+    size_t block = (size_t)(DETECT_BLOCK_SECONDS * fmt.sample_rate);
+    if (block < 8) {
+        block = 8;
+    }
+    
+    // Correlating against fixed cos/sin tables gives the Goertzel bin as two dot products
+    float *cos_tab = malloc(block * sizeof(float));
+    float *sin_tab = malloc(block * sizeof(float));
+    float *samples = malloc(block * sizeof(float));
+    if (!cos_tab || !sin_tab || !samples) {
+        fprintf(stderr, "Error: out of memory\n");
+        result = EXIT_FILE_ERROR;
+        goto cleanup;
+    }
+    for (size_t n = 0; n < block; n++) {
+        double phase = 2.0 * M_PI * settings->tone_hz * (double)n / fmt.sample_rate;
+        cos_tab[n] = (float)cos(phase);
+        sin_tab[n] = (float)sin(phase);
+    }
+    
+    double block_seconds = (double)block / fmt.sample_rate;
+    double peak_decay = exp(-block_seconds / PEAK_DECAY_SECONDS);
+    double noise_rise = block_seconds / NOISE_RISE_SECONDS;
+    double peak = 0.0;
+    double noise = 0.0;
+    int key_down = 0;
+    double run = 0.0;           // blocks spent in the current key state
+    
+    KeyingDecoder k;
+    keying_init(&k, settings, block_seconds);
+    
+    size_t frame_bytes = (size_t)fmt.channels * (size_t)(fmt.bits / 8);
+    size_t frames_per_read = sizeof(raw) / frame_bytes;
+    size_t filled = 0;
+    uint64_t remaining = fmt.data_bytes;
+    
+    for (;;) {
+        size_t want = frames_per_read * frame_bytes;
+        if (remaining < want) {
+            want = (size_t)(remaining / frame_bytes * frame_bytes);
+        }
+        size_t got = want > 0 ? fread(raw, 1, want, input) : 0;
+        if (got < frame_bytes) {
+            break;
+        }
+        if (remaining != UINT64_MAX) {
+            remaining -= got;
+        }
+        
+        // First channel only
+        for (size_t f = 0; f + frame_bytes <= got; f += frame_bytes) {
+            const unsigned char *p = raw + f;
+            samples[filled++] = fmt.bits == 16 ? (float)(int16_t)(p[0] | (p[1] << 8)) / 32768.0f
+                                               : (float)(p[0] - 128) / 128.0f;
+            if (filled < block) {
+                continue;
+            }
+            filled = 0;
             
-            if (c == ' ' || c == '\t') {
-                // Space separates morse characters
-                if (buffer_pos > 0) {
-                    morse_buffer[buffer_pos] = '\0';
-                    char decoded = morse_to_char(morse_buffer);
-                    
-                    if (decoded == '?' && strcmp(morse_buffer, "/") != 0) {
-                        invalid_sequences++;
-                        if (invalid_sequences <= 10) {
-                            fprintf(stderr, "Warning: unknown morse sequence '%s'\n", morse_buffer);
-                        }
-                    }
-                    
-                    if (!safe_fputc(decoded, output)) {
-                        return EXIT_FILE_ERROR;
-                    }
-                    buffer_pos = 0;
-                }
-            } else if (c == '/' || c == '\n') {
-                // Forward slash or newline separates words
-                if (buffer_pos > 0) {
-                    morse_buffer[buffer_pos] = '\0';
-                    char decoded = morse_to_char(morse_buffer);
-                    
-                    if (decoded == '?' && strcmp(morse_buffer, "/") != 0) {
-                        invalid_sequences++;
-                        if (invalid_sequences <= 10) {
-                            fprintf(stderr, "Warning: unknown morse sequence '%s'\n", morse_buffer);
-                        }
-                    }
-                    
-                    if (!safe_fputc(decoded, output)) {
-                        return EXIT_FILE_ERROR;
-                    }
-                    buffer_pos = 0;
-                }
-                if (c == '/') {
-                    if (!safe_fputc(' ', output)) {  // Word separator becomes space
-                        return EXIT_FILE_ERROR;
-                    }
-                } else {
-                    if (!safe_fputc('\n', output)) { // Preserve newlines
-                        return EXIT_FILE_ERROR;
-                    }
-                }
-            } else if (c == '.' || c == '-') {
-                // Morse code characters
-                if (buffer_pos < MAX_MORSE_LENGTH) {
-                    morse_buffer[buffer_pos++] = c;
-                } else {
-                    fprintf(stderr, "Warning: morse sequence too long, truncating\n");
-                    buffer_pos = 0;  // Reset buffer
-                }
+            float re = 0.0f, im = 0.0f;
+            for (size_t n = 0; n < block; n++) {
+                re += samples[n] * cos_tab[n];
+                im += samples[n] * sin_tab[n];
+            }
+            double level = sqrt((double)re * re + (double)im * im) / (double)block;
+            
+            // Fast-attack peak and fast-release noise floor bracket the threshold
+            peak = level > peak ? level : peak * peak_decay;
+            noise = level < noise ? level : noise + (level - noise) * noise_rise;
+            double span = peak - noise;
+            int has_signal = span > 3.0 * noise && span > 1e-4;
+            int now_down = has_signal && (key_down ? level > noise + 0.4 * span
+                                                   : level > noise + 0.6 * span);
+            
+            if (now_down == key_down) {
+                run += 1.0;
+                continue;
+            }
+            
+            if (!keying_event(&k, key_down ? run : -run, output)) {
+                result = EXIT_FILE_ERROR;
+                goto cleanup;
             }
-            // Ignore other characters silently
+            key_down = now_down;
+            run = 1.0;
         }
     }
     
-    // Check for read error
     if (ferror(input)) {
         fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
-        return EXIT_FILE_ERROR;
+        result = EXIT_FILE_ERROR;
+        goto cleanup;
     }
     
-    // Handle any remaining morse in buffer
-    if (buffer_pos > 0) {
-        morse_buffer[buffer_pos] = '\0';
-        char decoded = morse_to_char(morse_buffer);
+    if ((key_down && !keying_event(&k, run, output)) || !keying_finish(&k, output)) {
+        result = EXIT_FILE_ERROR;
+    }
+
+cleanup:
+    free(cos_tab);
+    free(sin_tab);
+    free(samples);
+    return result;
+}
+
+// Decode signed key durations in milliseconds (positive = key down,
+// negative = key up), as text numbers or little-endian int32 values
+int decode_keyed(FILE *input, FILE *output, int binary, const AudioSettings *settings) {
+    unsigned char buffer[BUFFER_SIZE];
+    size_t bytes_read;
+    size_t carry = 0;           // partial int32 bytes left from the previous read
+    long value = 0;
+    int has_sign = 0;
+    int negative = 0;
+    int in_number = 0;
+    int bad_input = 0;
+    KeyingDecoder k;
+    
+    keying_init(&k, settings, 0.001);
+    
+    while ((bytes_read = fread(buffer + carry, 1, sizeof(buffer) - carry, input)) > 0) {
+        size_t len = carry + bytes_read;
         
-        if (decoded == '?' && strcmp(morse_buffer, "/") != 0) {
-            invalid_sequences++;
-            if (invalid_sequences <= 10) {
-                fprintf(stderr, "Warning: unknown morse sequence '%s'\n", morse_buffer);
+        if (binary) {
+            size_t whole = len - len % 4;
+            for (size_t i = 0; i < whole; i += 4) {
+                int32_t duration = (int32_t)((uint32_t)buffer[i] | ((uint32_t)buffer[i + 1] << 8) |
+                                             ((uint32_t)buffer[i + 2] << 16) | ((uint32_t)buffer[i + 3] << 24));
+                if (!keying_event(&k, (double)duration, output)) {
+                    return EXIT_FILE_ERROR;
+                }
             }
+            carry = len - whole;
+            memmove(buffer, buffer + whole, carry);
+            continue;
         }
         
-        if (!safe_fputc(decoded, output)) {
-            return EXIT_FILE_ERROR;
+        for (size_t i = 0; i < len; i++) {
+            int c = buffer[i];
+            
+            if (c >= '0' && c <= '9') {
+                if (value < LONG_MAX / 10) {
+                    value = value * 10 + (c - '0');
+                }
+                in_number = 1;
+                continue;
+            }
+            
+            if (in_number) {
+                if (!keying_event(&k, negative ? -(double)value : (double)value, output)) {
+                    return EXIT_FILE_ERROR;
+                }
+            } else if (has_sign) {
+                bad_input++;    // Sign without digits
+            }
+            
+            value = 0;
+            in_number = 0;
+            has_sign = c == '-' || c == '+';
+            negative = c == '-';
+            if (!has_sign && !isspace(c) && c != ',') {
+                bad_input++;
+            }
         }
     }
     
-    if (invalid_sequences > 10) {
-        fprintf(stderr, "Warning: %d total invalid morse sequences found\n", invalid_sequences);
+    if (ferror(input)) {
+        fprintf(stderr, "Error: read failed: %s\n", strerror(errno));
+        return EXIT_FILE_ERROR;
     }
     
-    if (!safe_fputc('\n', output)) {
+    if (in_number && !keying_event(&k, negative ? -(double)value : (double)value, output)) {
         return EXIT_FILE_ERROR;
     }
+    if (carry > 0) {
+        fprintf(stderr, "Warning: ignoring %zu trailing bytes (not a whole int32)\n", carry);
+    }
+    if (bad_input > 0) {
+        fprintf(stderr, "Warning: ignored %d malformed entries in duration input\n", bad_input);
+    }
     
-    return EXIT_SUCCESS;
+    return keying_finish(&k, output) ? EXIT_SUCCESS : EXIT_FILE_ERROR;
 }
 
 int main(int argc, char *argv[]) {
     int decode_mode = 0;
+    int decode_wav_mode = 0;
+    int keyed_mode = 0;         // 1 = text durations, 2 = int32 durations
+    int keying_output = 0;      // 1 = timing text, 2 = packed bitstream
+    int fuzzy_length = 0;       // 0 = exact decoding only
     const char *char_separator = " ";      // Default separator between characters
     const char *word_separator = " / ";    // Default separator between words
+    int custom_separators = 0;
+    const char *wav_path = NULL;
+    const Alphabet *alphabet = &alphabets[0];
+    AudioSettings audio = { DEFAULT_WPM, 0, DEFAULT_TONE_HZ, DEFAULT_SAMPLE_RATE };
     const char *filename = NULL;
     FILE *input = stdin;
     FILE *output = stdout;
@@ -302,7 +2044,19 @@ int main(int argc, char *argv[]) {
     static struct option long_options[] = {
         {"decode", no_argument, 0, 'd'},
         {"separator", required_argument, 0, 's'},
+        {"char-sep", required_argument, 0, 's'},
         {"word-sep", required_argument, 0, 'w'},
+        {"wav", required_argument, 0, OPT_WAV},
+        {"wpm", required_argument, 0, OPT_WPM},
+        {"farnsworth", required_argument, 0, OPT_FARNSWORTH},
+        {"tone-hz", required_argument, 0, OPT_TONE_HZ},
+        {"sample-rate", required_argument, 0, OPT_SAMPLE_RATE},
+        {"decode-wav", no_argument, 0, OPT_DECODE_WAV},
+        {"keyed", optional_argument, 0, OPT_KEYED},
+        {"alphabet", required_argument, 0, OPT_ALPHABET},
+        {"fuzzy", optional_argument, 0, OPT_FUZZY},
+        {"timing", no_argument, 0, OPT_TIMING},
+        {"bitstream", no_argument, 0, OPT_BITSTREAM},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {0, 0, 0, 0}
@@ -319,12 +2073,69 @@ int main(int argc, char *argv[]) {
                     return EXIT_INVALID_ARGS;
                 }
                 char_separator = optarg;
+                custom_separators = 1;
                 break;
             case 'w':
                 if (!validate_separator(optarg, "word separator")) {
                     return EXIT_INVALID_ARGS;
                 }
                 word_separator = optarg;
+                custom_separators = 1;
+                break;
+            case OPT_WAV:
+                wav_path = optarg;
+                break;
+            case OPT_WPM:
+                if (!parse_int_option(optarg, "wpm", 1, 200, &audio.wpm)) {
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_FARNSWORTH:
+                if (!parse_int_option(optarg, "farnsworth wpm", 1, 200, &audio.farnsworth_wpm)) {
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_TONE_HZ:
+                if (!parse_int_option(optarg, "tone frequency", 20, 20000, &audio.tone_hz)) {
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_SAMPLE_RATE:
+                if (!parse_int_option(optarg, "sample rate", 4000, 192000, &audio.sample_rate)) {
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_DECODE_WAV:
+                decode_wav_mode = 1;
+                break;
+            case OPT_KEYED:
+                if (!optarg || strcmp(optarg, "text") == 0) {
+                    keyed_mode = 1;
+                } else if (strcmp(optarg, "int32") == 0) {
+                    keyed_mode = 2;
+                } else {
+                    fprintf(stderr, "Error: unknown keyed format '%s' (use 'text' or 'int32')\n", optarg);
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_FUZZY:
+                fuzzy_length = MAX_MORSE_LENGTH;
+                if (optarg && !parse_int_option(optarg, "fuzzy length", 1, MAX_FUZZY_LENGTH, &fuzzy_length)) {
+                    return EXIT_INVALID_ARGS;
+                }
+                break;
+            case OPT_TIMING:
+                keying_output = 1;
+                break;
+            case OPT_BITSTREAM:
+                keying_output = 2;
+                break;
+            case OPT_ALPHABET:
+                alphabet = find_alphabet(optarg);
+                if (!alphabet) {
+                    fprintf(stderr, "Error: unknown alphabet '%s' (use latin, cyrillic, greek or wabun)\n", optarg);
+                    return EXIT_INVALID_ARGS;
+                }
                 break;
             case 'h':
                 print_usage(argv[0]);
@@ -338,6 +2149,25 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (!load_alphabet(alphabet)) {
+        return EXIT_INVALID_ARGS;
+    }
+    if ((decode_mode || decode_wav_mode || keyed_mode) && fuzzy_length > 0 && !build_fuzzy_table(fuzzy_length)) {
+        return EXIT_FILE_ERROR;
+    }
+    
+    // Decoding recognises exactly the given separators, so they must be unambiguous
+    if (decode_mode && custom_separators) {
+        if (!validate_decode_separator(char_separator, "character separator") ||
+            !validate_decode_separator(word_separator, "word separator")) {
+            return EXIT_INVALID_ARGS;
+        }
+        if (strcmp(char_separator, word_separator) == 0) {
+            fprintf(stderr, "Error: character and word separators must differ for decoding\n");
+            return EXIT_INVALID_ARGS;
+        }
+    }
+    
     // Get filename if provided
     if (optind < argc) {
         filename = argv[optind];
@@ -349,7 +2179,7 @@ int main(int argc, char *argv[]) {
     
     // Open input file (or use stdin)
     if (filename && strcmp(filename, "-") != 0) {
-        input = fopen(filename, "r");
+        input = fopen(filename, decode_wav_mode || keyed_mode == 2 ? "rb" : "r");
         if (!input) {
             fprintf(stderr, "Error: cannot open '%s': %s\n", filename, strerror(errno));
             return EXIT_FILE_ERROR;
@@ -357,12 +2187,27 @@ int main(int argc, char *argv[]) {
     }
     
     // Do the conversion
-    if (decode_mode) {
-        result = decode_morse(input, output);
+    if (keyed_mode) {
+        result = decode_keyed(input, output, keyed_mode == 2, &audio);
+    } else if (decode_wav_mode) {
+        result = decode_wav(input, output, &audio);
+    } else if (decode_mode) {
+        result = decode_morse(input, output, custom_separators ? char_separator : NULL, word_separator);
+    } else if (keying_output) {
+        result = encode_keying(input, output, keying_output == 1, &audio);
+    } else if (wav_path) {
+        if (audio.tone_hz * 2 >= audio.sample_rate) {
+            fprintf(stderr, "Error: tone frequency must be below half the sample rate\n");
+            result = EXIT_INVALID_ARGS;
+        } else {
+            result = encode_wav(input, wav_path, &audio);
+        }
     } else {
         result = encode_morse(input, output, char_separator, word_separator);
     }
     
+    report_fuzzy();
+    
     // Ensure output is flushed
     if (fflush(output) != 0) {
         fprintf(stderr, "Error: failed to flush output: %s\n", strerror(errno));
@@ -370,6 +2215,7 @@ int main(int argc, char *argv[]) {
     }
     
     // Cleanup
+    free(fuzzy.table);
     if (input != stdin && fclose(input) != 0) {
         fprintf(stderr, "Warning: failed to close input file: %s\n", strerror(errno));
     }